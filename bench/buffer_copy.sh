@@ -0,0 +1,72 @@
+#!/bin/bash
+#
+# Copyright © 2016 Andrey Nevolin, https://github.com/AndreyNevolin
+# Twitter: @Andrey_Nevolin
+# LinkedIn: https://www.linkedin.com/in/andrey-nevolin-76387328
+#
+# Compare layouts of the double-buffer used by the "rw" engine. For each
+# combination of chunk size and number of pieces the input is split with the
+# mirrored ring and with the buffer of two halves. Reported are the number of
+# bytes moved inside the buffer per byte of output and wall-clock time
+#
+# Usage: buffer_copy.sh <path to debug build of split> [input size in MB]
+#
+# The debug build is required because only it reports the number of moved
+# bytes. Input file is generated in FASTA format with short records
+
+set -e
+
+SPLIT=$1
+INPUT_MB=${2:-256}
+
+if [ -z "$SPLIT" ]
+then
+    echo "Usage: $0 <path to debug build of split> [input size in MB]"
+    exit 1
+fi
+
+WORK_DIR=$(mktemp -d)
+trap "rm -rf $WORK_DIR" EXIT
+
+INPUT=$WORK_DIR/input.fa
+
+awk -v size=$((INPUT_MB * 1024 * 1024)) 'BEGIN {
+    srand( 1);
+    seq = "";
+    while ( length( seq) < 1000 )
+    {
+        seq = seq substr( "ACGT", int( rand() * 4) + 1, 1);
+    }
+    for ( i = 0; written < size; i++ )
+    {
+        len = 50 + int( rand() * 250);
+        printf( ">read%d\n%s\n", i, substr( seq, int( rand() * 700) + 1, len));
+        written += length( i) + len + 7;
+    }
+}' > $INPUT
+
+if ! "$SPLIT" -n 2 --od $WORK_DIR $INPUT | grep -q "^Bytes moved"
+then
+    echo "\"$SPLIT\" is not a debug build. Run \"make clean debug\" first"
+    exit 1
+fi
+
+printf "%-8s %10s %8s %16s %10s\n" "layout" "chunk" "pieces" "moved/output" "seconds"
+
+for CHUNK in 64K 1M 4M
+do
+    for PIECES in 16 256
+    do
+        for LAYOUT in halves mirror
+        do
+            rm -f $WORK_DIR/out.*
+            START=$(date +%s.%N)
+            RATIO=$("$SPLIT" -n $PIECES --cs $CHUNK --buffer $LAYOUT --od $WORK_DIR \
+                             --of out $INPUT \
+                    | sed -n 's/^Bytes moved.*(\([0-9.]*\) per byte of output)$/\1/p')
+            END=$(date +%s.%N)
+            printf "%-8s %10s %8s %16s %10.3f\n" $LAYOUT $CHUNK $PIECES $RATIO \
+                   $(awk "BEGIN { print $END - $START }")
+        done
+    done
+done
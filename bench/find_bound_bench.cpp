@@ -0,0 +1,196 @@
+/**
+ * Copyright © 2016 Andrey Nevolin, https://github.com/AndreyNevolin
+ * Twitter: @Andrey_Nevolin
+ * LinkedIn: https://www.linkedin.com/in/andrey-nevolin-76387328
+ *
+ * Microbenchmark of the element bound search. Compares the byte-by-byte
+ * reference implementation of the FASTA bound finder with the vectorized one
+ * running on top of each implementation of the byte search supported by the
+ * processor
+ *
+ * Two inputs are generated in memory: FASTA with short records (typical for
+ * sequencing reads) and FASTA with long records (typical for assembled
+ * contigs). The bound search is run on windows of the chunk size placed at
+ * random offsets of the input, with random projected bounds. Results of all
+ * implementations are checked to be identical
+ *
+ * Usage: find_bound_bench [chunk size in KB]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <vector>
+
+#define SPLIT_ASSERT( condition_)
+#define SPLIT_BOUND_NOT_FOUND -12345
+#include "../byte_search.cpp"
+#include "../find_bound_fasta.cpp"
+
+/* Size of each generated input */
+#define BENCH_INPUT_SIZE (256 * 1024 * 1024)
+
+/**
+ * Search request: window of the input and projected bound inside it
+ */
+typedef struct
+{
+    int64_t offset;
+    int64_t projected_bound;
+    bool is_first_block;
+} bench_Request_t;
+
+/**
+ * Generate FASTA with record lengths distributed uniformly
+ * in [min_len, max_len]
+ */
+static void bench_GenerateFasta( std::vector<char> &input, int64_t min_len,
+                                 int64_t max_len)
+{
+    const char nucleotides[] = "ACGT";
+    int64_t record_num = 0;
+
+    input.clear();
+    input.reserve( BENCH_INPUT_SIZE);
+
+    while ( (int64_t)input.size() < BENCH_INPUT_SIZE )
+    {
+        char id[32];
+        int64_t len = min_len + random() % (max_len - min_len + 1);
+
+        snprintf( id, sizeof( id), ">record_%ld\n", (long)record_num++);
+        input.insert( input.end(), id, id + strlen( id));
+
+        for ( int64_t i = 0; i < len; i++ )
+        {
+            input.push_back( nucleotides[random() % 4]);
+        }
+
+        input.push_back( '\n');
+    }
+}
+
+static double bench_GetTime()
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Run all the requests with the given implementation of the bound search.
+ * Results are placed into "results". Return time spent per request in
+ * nanoseconds
+ */
+template <typename FindBound>
+static double bench_Run( const std::vector<char> &input, int64_t chunk_size,
+                         const std::vector<bench_Request_t> &requests,
+                         std::vector<int64_t> &results, FindBound find_bound)
+{
+    double start = bench_GetTime();
+
+    results.resize( requests.size());
+
+    for ( size_t i = 0; i < requests.size(); i++ )
+    {
+        const bench_Request_t &request = requests[i];
+
+        results[i] = find_bound( &input[request.offset], request.projected_bound,
+                                 chunk_size, request.is_first_block);
+    }
+
+    return (bench_GetTime() - start) * 1e9 / requests.size();
+}
+
+/**
+ * Benchmark all the implementations on one input. Return "false" if results
+ * of the implementations differ
+ */
+static bool bench_Input( const char *input_name, const std::vector<char> &input,
+                         int64_t chunk_size, int num_requests)
+{
+    std::vector<bench_Request_t> requests( num_requests);
+    std::vector<int64_t> reference, results;
+
+    for ( int i = 0; i < num_requests; i++ )
+    {
+        requests[i].offset = random() % (input.size() - chunk_size);
+        requests[i].projected_bound = random() % chunk_size;
+        requests[i].is_first_block = random() % 2;
+    }
+
+    double scalar_time = bench_Run( input, chunk_size, requests, reference,
+                                    split_FindBoundScalar);
+
+    printf( "%-8s %-8s %12.0f %8.2f\n", input_name, "scalar", scalar_time, 1.0);
+
+    for ( const split_ByteSearch_t *search = split_byte_searches; search->name;
+          search++ )
+    {
+        if ( !search->is_supported() )
+        {
+            printf( "%-8s %-8s %12s %8s\n", input_name, search->name, "-", "-");
+
+            continue;
+        }
+
+        double time = bench_Run( input, chunk_size, requests, results,
+                                 [search]( const char *buff, int64_t projected_bound,
+                                           int64_t buff_size, bool is_first_block)
+                                 {
+                                     return split_FindBoundVector<true>( search, buff,
+                                                                         projected_bound,
+                                                                         buff_size,
+                                                                         is_first_block);
+                                 });
+
+        for ( int i = 0; i < num_requests; i++ )
+        {
+            if ( results[i] != reference[i] )
+            {
+                fprintf( stderr, "Mismatch: input \"%s\", implementation \"%s\", "
+                         "offset %ld, projected bound %ld: %ld instead of %ld\n",
+                         input_name, search->name, (long)requests[i].offset,
+                         (long)requests[i].projected_bound, (long)results[i],
+                         (long)reference[i]);
+
+                return false;
+            }
+        }
+
+        printf( "%-8s %-8s %12.0f %8.2f\n", input_name, search->name, time,
+                scalar_time / time);
+    }
+
+    return true;
+}
+
+int main( int argc, char *argv[])
+{
+    int64_t chunk_size = (argc > 1 ? atol( argv[1]) : 4096) * 1024;
+    std::vector<char> input;
+    bool is_ok = true;
+
+    srandom( 1);
+    printf( "Chunk size: %ld bytes. Time is per search in nanoseconds\n",
+            (long)chunk_size);
+    printf( "%-8s %-8s %12s %8s\n", "input", "kernel", "time", "speedup");
+
+    /* Short reads. The bound is generally found within a few hundred bytes
+       from the projected one */
+    bench_GenerateFasta( input, 100, 300);
+    is_ok = bench_Input( "short", input, chunk_size, 200000) && is_ok;
+
+    /* Long contigs. The bound is generally megabytes away from the projected
+       one, or not found inside the window at all */
+    bench_GenerateFasta( input, 1024 * 1024, 16 * 1024 * 1024);
+    is_ok = bench_Input( "long", input, chunk_size, 200) && is_ok;
+
+    return is_ok ? 0 : 1;
+}
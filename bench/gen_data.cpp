@@ -0,0 +1,178 @@
+/**
+ * Copyright © 2016 Andrey Nevolin, https://github.com/AndreyNevolin
+ * Twitter: @Andrey_Nevolin
+ * LinkedIn: https://www.linkedin.com/in/andrey-nevolin-76387328
+ *
+ * Generator of synthetic FASTA and FASTQ inputs for benchmarks. Lengths of
+ * sequences follow one of the distributions:
+ *   short - uniform in [50, 300] (sequencing reads)
+ *   long  - log-uniform in [1K, 1M] (assembled contigs, long reads)
+ *   giant - short records with a single giant record of half of the input
+ *           in the middle. It's adversarial for chunk sizes smaller than the
+ *           giant record
+ *
+ * Sequences are cut at random offsets of a pool of random nucleotides, so
+ * generation runs at memory speed. Output is deterministic for a given seed
+ *
+ * Usage: gen_data <fasta | fastq> <short | long | giant> <size in MB> [seed]
+ *
+ * Data is written to the standard output
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+/* Size of the pools of nucleotides and qualities */
+#define GEN_POOL_SIZE (4 * 1024 * 1024)
+/* Size of the output buffer */
+#define GEN_OUT_BUFF_SIZE (4 * 1024 * 1024)
+
+/**
+ * State of the xorshift64* generator
+ */
+static uint64_t gen_state = 1;
+
+static uint64_t gen_Random()
+{
+    gen_state ^= gen_state >> 12;
+    gen_state ^= gen_state << 25;
+    gen_state ^= gen_state >> 27;
+
+    return gen_state * 2685821657736338717ULL;
+}
+
+/**
+ * Random integer in [min, max]
+ */
+static int64_t gen_RandomIn( int64_t min, int64_t max)
+{
+    return min + (int64_t)(gen_Random() % (uint64_t)(max - min + 1));
+}
+
+/**
+ * Output buffered in memory and flushed to the standard output
+ */
+static std::string gen_out;
+
+static void gen_Flush()
+{
+    if ( fwrite( gen_out.data(), 1, gen_out.size(), stdout) != gen_out.size() )
+    {
+        fprintf( stderr, "Cannot write to the standard output\n");
+        exit( EXIT_FAILURE);
+    }
+
+    gen_out.clear();
+}
+
+/**
+ * Append a part of a pool to the output. Parts longer than the pool are
+ * composed of several pieces of it
+ */
+static void gen_AppendFromPool( const std::vector<char> & pool, int64_t len)
+{
+    while ( len )
+    {
+        int64_t piece_len = std::min( len, (int64_t)pool.size() / 2);
+        int64_t offset = gen_RandomIn( 0, pool.size() - piece_len);
+
+        gen_out.append( &pool[offset], piece_len);
+        len -= piece_len;
+
+        if ( gen_out.size() >= GEN_OUT_BUFF_SIZE )
+        {
+            gen_Flush();
+        }
+    }
+}
+
+int main( int argc, char *argv[])
+{
+    if ( argc < 4 )
+    {
+        fprintf( stderr, "Usage: %s <fasta | fastq> <short | long | giant> "
+                 "<size in MB> [seed]\n", argv[0]);
+
+        return EXIT_FAILURE;
+    }
+
+    bool is_fastq = !strcmp( argv[1], "fastq");
+    std::string distribution = argv[2];
+    int64_t size = atol( argv[3]) * 1024 * 1024;
+
+    if ( (!is_fastq && strcmp( argv[1], "fasta"))
+         || ((distribution != "short") && (distribution != "long")
+             && (distribution != "giant")) )
+    {
+        fprintf( stderr, "Unknown format or distribution\n");
+
+        return EXIT_FAILURE;
+    }
+
+    gen_state = (argc > 4) ? atol( argv[4]) * 2654435761ULL + 1 : 1;
+
+    std::vector<char> nucleotides( GEN_POOL_SIZE), qualities( GEN_POOL_SIZE);
+
+    for ( int64_t i = 0; i < GEN_POOL_SIZE; i++ )
+    {
+        nucleotides[i] = "ACGT"[gen_Random() % 4];
+        /* Phred+33 qualities from 2 to 41 */
+        qualities[i] = '#' + gen_Random() % 40;
+    }
+
+    int64_t written = 0;
+    bool is_giant_written = false;
+
+    for ( int64_t record_num = 0; written < size; record_num++ )
+    {
+        int64_t len = 0;
+
+        if ( distribution == "long" )
+        {
+            len = (int64_t)exp( log( 1000.0) + (gen_Random() % 1000000) / 1000000.0
+                                               * (log( 1000000.0) - log( 1000.0)));
+        } else if ( (distribution == "giant") && !is_giant_written
+                    && (written >= size / 4) )
+        {
+            len = size / 2;
+            is_giant_written = true;
+        } else
+        {
+            len = gen_RandomIn( 50, 300);
+        }
+
+        size_t start = gen_out.size();
+        char header[64];
+
+        snprintf( header, sizeof( header), "%crecord%ld\n", is_fastq ? '@' : '>',
+                  record_num);
+        gen_out += header;
+        written += gen_out.size() - start;
+        gen_AppendFromPool( nucleotides, len);
+        gen_out += is_fastq ? "\n+\n" : "\n";
+
+        if ( is_fastq )
+        {
+            gen_AppendFromPool( qualities, len);
+            gen_out += "\n";
+        }
+
+        written += len * (is_fastq ? 2 : 1) + (is_fastq ? 4 : 1);
+
+        if ( gen_out.size() >= GEN_OUT_BUFF_SIZE )
+        {
+            gen_Flush();
+        }
+    }
+
+    gen_Flush();
+
+    return EXIT_SUCCESS;
+}
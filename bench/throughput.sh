@@ -0,0 +1,152 @@
+#!/bin/bash
+#
+# Copyright © 2016 Andrey Nevolin, https://github.com/AndreyNevolin
+# Twitter: @Andrey_Nevolin
+# LinkedIn: https://www.linkedin.com/in/andrey-nevolin-76387328
+#
+# Throughput benchmark of the tool. Synthetic inputs are generated by
+# "gen_data" for each data set. Each input is split for a matrix of chunk
+# sizes, numbers of pieces and I/O modes, on tmpfs and on disk. Copying the
+# input with "cat" and "dd" is measured as the baseline. Reported are
+# throughput (GB/s of input) and CPU time (user plus system)
+#
+# Usage: throughput.sh <path to split> <path to gen_data> [input size in MB]
+#                      [results file]
+#
+# Results are printed as a table and appended to the results file (by default
+# "bench-results.jsonl" in the current directory) as JSON lines for trend
+# tracking. A run that fails (for example, on a record exceeding "--max-memory")
+# is reported with status "error"
+#
+# The matrix may be narrowed with environment variables (space-separated
+# lists):
+#   BENCH_DATA   - data sets as "<format>-<distribution>" (see "gen_data.cpp")
+#   BENCH_CHUNKS - chunk sizes
+#   BENCH_PIECES - numbers of pieces
+#   BENCH_MODES  - I/O modes as options of the tool with '_' instead of spaces
+#   BENCH_DIRS   - directories to run in. By default "/dev/shm" (tmpfs) and
+#                  the current directory (disk)
+# If BENCH_DROP_CACHES is "1", the page cache is dropped before each run on
+# disk (requires root)
+
+set -e
+
+SPLIT=$1
+GEN_DATA=$2
+INPUT_MB=${3:-256}
+RESULTS=${4:-bench-results.jsonl}
+
+if [ -z "$SPLIT" ] || [ -z "$GEN_DATA" ]
+then
+    echo "Usage: $0 <path to split> <path to gen_data> [input size in MB]" \
+         "[results file]"
+    exit 1
+fi
+
+SPLIT=$(realpath "$SPLIT")
+GEN_DATA=$(realpath "$GEN_DATA")
+RESULTS=$(realpath "$RESULTS")
+
+DATA_SETS=${BENCH_DATA:-"fasta-short fastq-short fasta-long fastq-giant"}
+CHUNKS=${BENCH_CHUNKS:-"64K 1M 4M"}
+PIECES=${BENCH_PIECES:-"4 64"}
+MODES=${BENCH_MODES:-"--engine_rw --engine_pipeline --engine_mmap --engine_copy -j_4"}
+
+if [ -z "$BENCH_DIRS" ]
+then
+    BENCH_DIRS="."
+
+    if [ -d /dev/shm ] && [ -w /dev/shm ]
+    then
+        BENCH_DIRS="/dev/shm ."
+    fi
+fi
+
+COMMIT=$(git -C "$(dirname "$0")" rev-parse --short HEAD 2>/dev/null || echo unknown)
+STAMP=$(date +%Y-%m-%dT%H:%M:%S)
+TIMEFORMAT="%R %U %S"
+
+printf "%-10s %-12s %-6s %-18s %6s %6s %8s %8s %8s\n" "fs" "data" "tool" "mode" \
+       "chunk" "pieces" "seconds" "cpu" "GB/s"
+
+# Run a command and report its time. Arguments: file system, data set, tool,
+# mode, chunk size, number of pieces, input size in bytes, command
+run_case()
+{
+    local fs=$1 data=$2 tool=$3 mode=$4 chunk=$5 pieces=$6 bytes=$7
+    local status=ok times
+
+    shift 7
+
+    if [ "$BENCH_DROP_CACHES" = "1" ] && [ "$fs" != "tmpfs" ]
+    then
+        sync
+        echo 3 > /proc/sys/vm/drop_caches
+    fi
+
+    if ! times=$( { time "$@" > /dev/null 2>&1 ; } 2>&1 )
+    then
+        status=error
+        times=$( echo "$times" | tail -1)
+    fi
+
+    read real user sys <<< "$times"
+
+    local cpu=$(awk "BEGIN { print $user + $sys }")
+    local gbps=$(awk "BEGIN { if ( $real > 0 ) printf \"%.3f\", $bytes / $real / 1e9; \
+                              else print 0 }")
+
+    if [ $status = error ]
+    then
+        gbps=error
+    fi
+
+    printf "%-10s %-12s %-6s %-18s %6s %6s %8.3f %8.3f %8s\n" $fs $data $tool \
+           "$mode" $chunk $pieces $real $cpu $gbps
+    printf '{"time":"%s","commit":"%s","fs":"%s","data":"%s","tool":"%s",' \
+           $STAMP $COMMIT $fs $data $tool >> "$RESULTS"
+    printf '"mode":"%s","chunk":"%s","pieces":%s,"bytes":%s,"seconds":%s,' \
+           "$mode" $chunk $pieces $bytes $real >> "$RESULTS"
+    printf '"cpu_seconds":%s,"status":"%s"}\n' $cpu $status >> "$RESULTS"
+}
+
+for DIR in $BENCH_DIRS
+do
+    WORK_DIR=$(mktemp -d "$DIR/split-bench.XXXXXX")
+    trap "rm -rf $WORK_DIR" EXIT
+    FS=$(stat -f -c %T "$WORK_DIR")
+
+    for DATA in $DATA_SETS
+    do
+        FORMAT=${DATA%-*}
+        INPUT=$WORK_DIR/input.$FORMAT
+
+        "$GEN_DATA" $FORMAT ${DATA#*-} $INPUT_MB > $INPUT
+
+        BYTES=$(stat -c %s $INPUT)
+
+        rm -f $WORK_DIR/out*
+        run_case $FS $DATA cat - - 1 $BYTES sh -c "cat $INPUT > $WORK_DIR/out"
+        rm -f $WORK_DIR/out*
+        run_case $FS $DATA dd bs=4M - 1 $BYTES \
+                 dd if=$INPUT of=$WORK_DIR/out bs=4M
+
+        for CHUNK in $CHUNKS
+        do
+            for N in $PIECES
+            do
+                for MODE in $MODES
+                do
+                    rm -f $WORK_DIR/out*
+                    run_case $FS $DATA split "${MODE//_/ }" $CHUNK $N $BYTES \
+                             "$SPLIT" -n $N --cs $CHUNK --format $FORMAT \
+                             ${MODE//_/ } --od $WORK_DIR --of out $INPUT
+                done
+            done
+        done
+
+        rm -f $WORK_DIR/out* $INPUT
+    done
+
+    rm -rf $WORK_DIR
+done
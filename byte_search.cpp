@@ -0,0 +1,237 @@
+/**
+ * Copyright © 2016 Andrey Nevolin, https://github.com/AndreyNevolin
+ * Twitter: @Andrey_Nevolin
+ * LinkedIn: https://www.linkedin.com/in/andrey-nevolin-76387328
+ *
+ * Vectorized search of a byte inside a memory range. Bound finders use it to
+ * skip quickly over long stretches of data that can't contain element bounds
+ *
+ * There are several implementations of the search: SSE2, AVX2 and AVX-512
+ * ones for x86 processors, and a portable one based on "memchr()" and
+ * "memrchr()" (counting is left to the compiler there). The fastest
+ * implementation supported by the processor is selected at run time
+ */
+
+#if defined( __x86_64__) || defined( __i386__)
+#include <immintrin.h>
+#endif
+
+/**
+ * Implementation of the byte search
+ */
+typedef struct
+{
+    /* Short name of the implementation */
+    const char *name;
+    /* Find first occurrence of byte "c" inside [begin, end). Return NULL if
+       there is no such byte */
+    const char *(*find_first)( const char *begin, const char *end, char c);
+    /* Find last occurrence of byte "c" inside [begin, end). Return NULL if
+       there is no such byte */
+    const char *(*find_last)( const char *begin, const char *end, char c);
+    /* Count occurrences of byte "c" inside [begin, end) */
+    int64_t (*count)( const char *begin, const char *end, char c);
+    /* Check if the processor supports the implementation */
+    bool (*is_supported)();
+} split_ByteSearch_t;
+
+#if defined( __x86_64__) || defined( __i386__)
+/**
+ * Get bit mask of positions of byte "c" inside a 64-byte block. These
+ * functions are the only ISA-specific part of the x86 implementations
+ */
+__attribute__(( target( "sse2"), always_inline))
+static inline uint64_t split_MaskSse2( const char *block, char c)
+{
+    __m128i pattern = _mm_set1_epi8( c);
+    uint64_t mask = 0;
+
+    for ( int i = 0; i < 4; i++ )
+    {
+        __m128i data = _mm_loadu_si128( (const __m128i *)(block + 16 * i));
+
+        mask |= (uint64_t)(uint16_t)_mm_movemask_epi8( _mm_cmpeq_epi8( data, pattern))
+                << (16 * i);
+    }
+
+    return mask;
+}
+
+__attribute__(( target( "avx2"), always_inline))
+static inline uint64_t split_MaskAvx2( const char *block, char c)
+{
+    __m256i pattern = _mm256_set1_epi8( c);
+    __m256i low = _mm256_loadu_si256( (const __m256i *)block);
+    __m256i high = _mm256_loadu_si256( (const __m256i *)(block + 32));
+    uint64_t low_mask = (uint32_t)_mm256_movemask_epi8( _mm256_cmpeq_epi8( low, pattern));
+    uint64_t high_mask = (uint32_t)_mm256_movemask_epi8( _mm256_cmpeq_epi8( high,
+                                                                            pattern));
+
+    return low_mask | (high_mask << 32);
+}
+
+__attribute__(( target( "avx512bw"), always_inline))
+static inline uint64_t split_MaskAvx512( const char *block, char c)
+{
+    return _mm512_cmpeq_epi8_mask( _mm512_loadu_si512( block), _mm512_set1_epi8( c));
+}
+
+/**
+ * Define search functions processing data in blocks of 64 bytes. The
+ * functions can't be templates parameterized by the mask function: GCC
+ * refuses to inline ISA-specific code into a function compiled for the
+ * baseline ISA. So each ISA gets its own copy of the functions, compiled
+ * with the corresponding target attribute
+ */
+#define SPLIT_DEFINE_BYTE_SEARCH( isa_, target_, mask_)                              \
+__attribute__(( target( target_)))                                                  \
+static const char *split_FindFirst##isa_( const char *begin, const char *end, char c) \
+{                                                                                   \
+    for ( ; end - begin >= 64; begin += 64 )                                        \
+    {                                                                               \
+        uint64_t mask = mask_( begin, c);                                           \
+                                                                                    \
+        if ( mask )                                                                 \
+        {                                                                           \
+            return begin + __builtin_ctzll( mask);                                  \
+        }                                                                           \
+    }                                                                               \
+                                                                                    \
+    for ( ; begin < end; begin++ )                                                  \
+    {                                                                               \
+        if ( *begin == c )                                                          \
+        {                                                                           \
+            return begin;                                                           \
+        }                                                                           \
+    }                                                                               \
+                                                                                    \
+    return NULL;                                                                    \
+}                                                                                   \
+                                                                                    \
+__attribute__(( target( target_)))                                                  \
+static const char *split_FindLast##isa_( const char *begin, const char *end, char c)  \
+{                                                                                   \
+    for ( ; end - begin >= 64; end -= 64 )                                          \
+    {                                                                               \
+        uint64_t mask = mask_( end - 64, c);                                        \
+                                                                                    \
+        if ( mask )                                                                 \
+        {                                                                           \
+            return end - 1 - __builtin_clzll( mask);                                \
+        }                                                                           \
+    }                                                                               \
+                                                                                    \
+    while ( end > begin )                                                           \
+    {                                                                               \
+        if ( *--end == c )                                                          \
+        {                                                                           \
+            return end;                                                             \
+        }                                                                           \
+    }                                                                               \
+                                                                                    \
+    return NULL;                                                                    \
+}                                                                                   \
+                                                                                    \
+__attribute__(( target( target_)))                                                  \
+static int64_t split_Count##isa_( const char *begin, const char *end, char c)       \
+{                                                                                   \
+    int64_t count = 0;                                                              \
+                                                                                    \
+    for ( ; end - begin >= 64; begin += 64 )                                        \
+    {                                                                               \
+        count += __builtin_popcountll( mask_( begin, c));                           \
+    }                                                                               \
+                                                                                    \
+    for ( ; begin < end; begin++ )                                                  \
+    {                                                                               \
+        count += (*begin == c);                                                     \
+    }                                                                               \
+                                                                                    \
+    return count;                                                                   \
+}                                                                                   \
+                                                                                    \
+static bool split_Supports##isa_()                                                  \
+{                                                                                   \
+    return __builtin_cpu_supports( target_);                                        \
+}
+
+SPLIT_DEFINE_BYTE_SEARCH( Sse2, "sse2", split_MaskSse2)
+SPLIT_DEFINE_BYTE_SEARCH( Avx2, "avx2", split_MaskAvx2)
+SPLIT_DEFINE_BYTE_SEARCH( Avx512, "avx512bw", split_MaskAvx512)
+#endif /* __x86_64__ || __i386__ */
+
+/**
+ * Portable implementation. "memchr()" and "memrchr()" are usually vectorized
+ * by the C library itself
+ */
+static const char *split_FindFirstLibc( const char *begin, const char *end, char c)
+{
+    return (const char *)memchr( begin, c, end - begin);
+}
+
+static const char *split_FindLastLibc( const char *begin, const char *end, char c)
+{
+    return (const char *)memrchr( begin, c, end - begin);
+}
+
+static int64_t split_CountLibc( const char *begin, const char *end, char c)
+{
+    int64_t count = 0;
+
+    for ( ; begin < end; begin++ )
+    {
+        count += (*begin == c);
+    }
+
+    return count;
+}
+
+static bool split_SupportsLibc()
+{
+    return true;
+}
+
+/**
+ * All implementations of the byte search. The most preferable go first
+ */
+static const split_ByteSearch_t split_byte_searches[] =
+{
+#if defined( __x86_64__) || defined( __i386__)
+    {"avx512", split_FindFirstAvx512, split_FindLastAvx512, split_CountAvx512,
+     split_SupportsAvx512},
+    {"avx2",   split_FindFirstAvx2,   split_FindLastAvx2,   split_CountAvx2,
+     split_SupportsAvx2},
+    {"sse2",   split_FindFirstSse2,   split_FindLastSse2,   split_CountSse2,
+     split_SupportsSse2},
+#endif
+    {"libc",   split_FindFirstLibc,   split_FindLastLibc,   split_CountLibc,
+     split_SupportsLibc},
+    {0,        0,                     0,                    0,                0}
+};
+
+/**
+ * Select the fastest implementation of the byte search supported by the
+ * processor
+ */
+static const split_ByteSearch_t *split_SelectByteSearch()
+{
+    const split_ByteSearch_t *search = split_byte_searches;
+
+    while ( !search->is_supported() )
+    {
+        search++;
+    }
+
+    return search;
+}
+
+/**
+ * Get the implementation of the byte search used by bound finders. It's
+ * selected on the first call
+ */
+static inline const split_ByteSearch_t *split_GetByteSearch()
+{
+    static const split_ByteSearch_t *search = split_SelectByteSearch();
+
+    return search;
+}
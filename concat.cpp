@@ -0,0 +1,268 @@
+/**
+ * Copyright © 2016 Andrey Nevolin, https://github.com/AndreyNevolin
+ * Twitter: @Andrey_Nevolin
+ * LinkedIn: https://www.linkedin.com/in/andrey-nevolin-76387328
+ *
+ * Concatenation of several input files
+ *
+ * Several input files are split as a single input, as if they were
+ * concatenated in the order given. Pieces are balanced over the whole input,
+ * and a piece may start in one file and end in another one. Files are
+ * concatenated as is, so each of them should end with a complete element (a
+ * text file should end with a newline). Compressed files are decompressed
+ * (see "inflate.cpp"), so compressed and uncompressed files may be mixed
+ *
+ * A single thread reads the files one after another ahead of the splitting
+ * loop. Data is produced into the queue of blocks of an inflater, so the
+ * splitting loop reads it exactly as decompressed data of a single file. When
+ * reading of a file starts, the next file is opened and the kernel is advised
+ * to read its beginning ahead. So the next file is being read from the disk
+ * while the current one is being split
+ */
+
+/* Size of blocks read from uncompressed input files */
+#define SPLIT_CONCAT_BLOCK_SIZE (1024 * 1024)
+/* Maximum number of blocks kept in memory */
+#define SPLIT_CONCAT_MAX_BLOCKS 8
+/* Amount of data read ahead from the beginning of the next file */
+#define SPLIT_CONCAT_READ_AHEAD (64 * 1024 * 1024)
+
+/**
+ * Open one of concatenated input files
+ */
+static int split_OpenConcatenated( const std::string & path)
+{
+    char err_msg[500];
+    int fd = open( path.c_str(), O_RDONLY);
+
+    if ( fd == -1 )
+    {
+        SPLIT_ERROR( "Cannot open file \"%s\": %s", path.c_str(),
+                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+    }
+
+    return fd;
+}
+
+/**
+ * Read data of an uncompressed file. Return amount of data read. It's less
+ * than "size" only at the end of the file
+ */
+static int64_t split_ReadConcatenatedFile( int fd, char *buff, int64_t size)
+{
+    char err_msg[500];
+    int64_t bytes_read = 0;
+
+    while ( bytes_read < size )
+    {
+        int64_t res = read( fd, buff + bytes_read, size - bytes_read);
+
+        if ( res == -1 )
+        {
+            if ( errno == EINTR )
+            {
+                continue;
+            }
+
+            SPLIT_ERROR( "Cannot read data from the input file: %s",
+                         SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+        } else if ( !res )
+        {
+            break;
+        }
+
+        bytes_read += res;
+    }
+
+    return bytes_read;
+}
+
+/**
+ * Thread reading input files one after another to blocks of the inflater.
+ * "num_threads" threads decompress each BGZF file
+ */
+static void split_ReadConcatenated( split_Inflater_t *inflater,
+                                    std::vector<std::string> paths,
+                                    int64_t num_threads)
+{
+    int fd = split_OpenConcatenated( paths[0]);
+
+    for ( size_t i = 0; i < paths.size(); i++ )
+    {
+        int fd_next = -1;
+        split_Compression_t compression = split_DetectCompression( fd);
+        split_Inflater_t file_inflater;
+        int64_t block_size = compression ? SPLIT_GZIP_BLOCK_SIZE
+                                         : SPLIT_CONCAT_BLOCK_SIZE;
+        int64_t bytes_read = 0;
+        split_OnError_t close_files( [&]()
+        {
+            if ( compression )
+            {
+                split_StopInflater( &file_inflater);
+            }
+
+            close( fd);
+
+            if ( fd_next != -1 )
+            {
+                close( fd_next);
+            }
+        });
+
+        /* Only hints. Failures are not important */
+        posix_fadvise( fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        if ( i + 1 < paths.size() )
+        {
+            fd_next = split_OpenConcatenated( paths[i + 1]);
+            posix_fadvise( fd_next, 0, SPLIT_CONCAT_READ_AHEAD, POSIX_FADV_WILLNEED);
+        }
+
+        if ( compression )
+        {
+            split_StartInflater( &file_inflater, fd, compression, num_threads);
+        }
+
+        do
+        {
+            split_InflatedBlock_t *block = new split_InflatedBlock_t();
+
+            block->is_done = false;
+            block->data.resize( block_size);
+
+            {
+                std::unique_lock<std::mutex> guard( inflater->lock);
+
+                while ( !inflater->is_stopped
+                        && (inflater->blocks.size() >= inflater->max_blocks) )
+                {
+                    inflater->cond.wait( guard);
+                }
+
+                if ( inflater->is_stopped )
+                {
+                    delete block;
+                    guard.unlock();
+
+                    if ( compression )
+                    {
+                        split_StopInflater( &file_inflater);
+                    }
+
+                    close( fd);
+
+                    if ( fd_next != -1 )
+                    {
+                        close( fd_next);
+                    }
+
+                    return;
+                }
+
+                inflater->blocks.push_back( block);
+            }
+
+            bytes_read = compression ? split_ReadInflated( &file_inflater,
+                                                           block->data.data(), block_size)
+                                     : split_ReadConcatenatedFile( fd, block->data.data(),
+                                                                   block_size);
+
+            std::lock_guard<std::mutex> guard( inflater->lock);
+
+            block->data.resize( bytes_read);
+            block->is_done = true;
+            inflater->cond.notify_all();
+        } while ( bytes_read == block_size );
+
+        if ( compression )
+        {
+            split_StopInflater( &file_inflater);
+        }
+
+        close( fd);
+        fd = fd_next;
+    }
+
+    std::lock_guard<std::mutex> guard( inflater->lock);
+
+    inflater->is_input_end = true;
+    inflater->cond.notify_all();
+}
+
+/**
+ * Start reading several input files as a single input. The data is read
+ * from the inflater (see "split_ReadInflated()") and the reading is stopped
+ * as decompression (see "split_StopInflater()")
+ */
+static void split_StartConcatenation( split_Inflater_t *inflater,
+                                      const std::vector<std::string> & paths,
+                                      int64_t num_threads)
+{
+    SPLIT_ASSERT( !paths.empty());
+
+    inflater->fd = -1;
+    inflater->compression = SPLIT_COMPRESSION_NONE;
+    inflater->offset = 0;
+    inflater->is_input_end = false;
+    inflater->is_stopped = false;
+    inflater->max_blocks = SPLIT_CONCAT_MAX_BLOCKS;
+    inflater->threads.push_back( split_StartWorker( &inflater->lock, &inflater->cond,
+                                                    std::bind( split_ReadConcatenated,
+                                                               inflater, paths,
+                                                               num_threads)));
+}
+
+/**
+ * Get total size of data of several input files (after decompression)
+ */
+static int64_t split_GetConcatenatedSize( const std::vector<std::string> & paths)
+{
+    char err_msg[500];
+    int64_t size = 0;
+
+    for ( size_t i = 0; i < paths.size(); i++ )
+    {
+        int fd = split_OpenConcatenated( paths[i]);
+        split_Compression_t compression = split_DetectCompression( fd);
+        struct stat input_stat;
+        split_OnError_t close_file( [&]()
+        {
+            close( fd);
+        });
+
+        if ( fstat( fd, &input_stat) == -1 )
+        {
+            SPLIT_ERROR( "Cannot get status of input file \"%s\": %s",
+                         paths[i].c_str(), SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+        }
+
+        /* Size of pipes and character devices is not known in advance */
+        if ( !S_ISREG( input_stat.st_mode) && !S_ISBLK( input_stat.st_mode) )
+        {
+            SPLIT_ERROR( "Input file \"%s\" is a stream. Use \"--piece-size\" to split "
+                         "it", paths[i].c_str());
+        }
+
+        if ( compression )
+        {
+            size += split_GetInflatedSize( fd, compression);
+        } else
+        {
+            /* Size of a block device is not reported by "fstat()" */
+            int64_t file_size = lseek( fd, 0, SEEK_END);
+
+            if ( file_size == -1 )
+            {
+                SPLIT_ERROR( "Cannot seek input file \"%s\": %s", paths[i].c_str(),
+                             SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+            }
+
+            size += file_size;
+        }
+
+        close( fd);
+    }
+
+    return size;
+}
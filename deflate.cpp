@@ -0,0 +1,341 @@
+/**
+ * Copyright © 2016 Andrey Nevolin, https://github.com/AndreyNevolin
+ * Twitter: @Andrey_Nevolin
+ * LinkedIn: https://www.linkedin.com/in/andrey-nevolin-76387328
+ *
+ * Compression of output files with gzip or BGZF
+ *
+ * Data of a piece is cut into blocks, and the blocks are compressed by a pool
+ * of threads independently of each other. Compressed blocks are taken in the
+ * order of the data and written by the splitting loop:
+ *   - for BGZF each block becomes a separate BGZF block. The file ends with
+ *     the standard empty end-of-file block
+ *   - for gzip each block is compressed as a raw deflate stream ending with a
+ *     sync flush (i.e. on a byte boundary with no final block). Such streams
+ *     concatenate into a single deflate stream. The file is a single gzip
+ *     member: a header, the blocks, an empty final deflate block and a
+ *     trailer with CRC32 combined from CRCs of the blocks
+ *
+ * Blocks of gzip are not primed with the tail of the preceding block. That
+ * costs a little of compression ratio, but keeps the blocks independent
+ */
+
+/* Maximum size of uncompressed data in a BGZF block. Compressed data is
+   guaranteed to fit into the maximum BGZF block size (64K) */
+#define SPLIT_BGZF_BLOCK_DATA_SIZE 65280
+/* Size of data compressed as a single block of gzip output */
+#define SPLIT_GZIP_DEFLATE_BLOCK_SIZE (1024 * 1024)
+/* Maximum number of blocks queued for compression per thread */
+#define SPLIT_DEFLATE_BLOCKS_PER_THREAD 8
+
+/* Empty BGZF block marking the end of a BGZF file */
+static const unsigned char split_bgzf_eof[] =
+{
+    0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00, 0x42,
+    0x43, 0x02, 0x00, 0x1b, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00
+};
+
+/* Header of a gzip member: no file name, no modification time, unknown OS */
+static const unsigned char split_gzip_header[] =
+{
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff
+};
+
+/* Empty final block of a deflate stream */
+static const unsigned char split_deflate_end[] = {0x03, 0x00};
+
+/**
+ * Block of data being compressed
+ */
+typedef struct
+{
+    /* Uncompressed data */
+    std::vector<char> data;
+    /* Compressed data */
+    std::vector<char> compressed;
+    /* CRC32 of uncompressed data */
+    uLong crc;
+    /* Indicator that compression of the block is finished */
+    bool is_done;
+} split_DeflatedBlock_t;
+
+/**
+ * Pool of threads compressing blocks of output files
+ */
+typedef struct
+{
+    split_Compression_t compression;
+    int level;
+    /* Blocks in the order of the data. The splitting loop takes them from the
+       front when they are compressed */
+    std::deque<split_DeflatedBlock_t *> blocks;
+    /* Blocks not yet taken by compressing threads */
+    std::deque<split_DeflatedBlock_t *> queue;
+    /* Maximum number of blocks in "blocks" */
+    size_t max_blocks;
+    bool is_stopped;
+    std::mutex lock;
+    std::condition_variable cond;
+    std::vector<std::thread> threads;
+} split_Deflater_t;
+
+/**
+ * Compress a block of data
+ */
+static void split_DeflateBlock( split_Compression_t compression,
+                                int level,
+                                split_DeflatedBlock_t *block)
+{
+    bool is_bgzf = (compression == SPLIT_COMPRESSION_BGZF);
+    int64_t header_size = is_bgzf ? SPLIT_BGZF_HEADER_SIZE : 0;
+    int64_t trailer_size = is_bgzf ? SPLIT_GZIP_TRAILER_SIZE : 0;
+    z_stream stream = z_stream();
+
+    if ( deflateInit2( &stream, level, Z_DEFLATED, -MAX_WBITS, 8,
+                       Z_DEFAULT_STRATEGY) != Z_OK )
+    {
+        SPLIT_ERROR( "Cannot initialize compression of output data");
+    }
+
+    /* Room for a sync flush marker is added to the bound */
+    block->compressed.resize( header_size + deflateBound( &stream, block->data.size())
+                              + 16 + trailer_size);
+    block->crc = crc32( crc32( 0, Z_NULL, 0), (const Bytef *)block->data.data(),
+                        block->data.size());
+    stream.next_in = (Bytef *)block->data.data();
+    stream.avail_in = block->data.size();
+    stream.next_out = (Bytef *)&block->compressed[header_size];
+    stream.avail_out = block->compressed.size() - header_size - trailer_size;
+
+    /* BGZF blocks are complete deflate streams. Blocks of gzip are parts of a
+       single stream */
+    int res = deflate( &stream, is_bgzf ? Z_FINISH : Z_SYNC_FLUSH);
+
+    /* Output space is not exhausted only if the flush is complete */
+    if ( (res != (is_bgzf ? Z_STREAM_END : Z_OK)) || stream.avail_in
+         || !stream.avail_out )
+    {
+        SPLIT_ERROR( "Cannot compress output data");
+    }
+
+    int64_t deflated_size = stream.total_out;
+
+    deflateEnd( &stream);
+    block->compressed.resize( header_size + deflated_size + trailer_size);
+
+    if ( is_bgzf )
+    {
+        unsigned char *header = (unsigned char *)&block->compressed[0];
+        unsigned char *trailer = header + header_size + deflated_size;
+        int64_t block_size = block->compressed.size() - 1;
+        int64_t data_size = block->data.size();
+
+        SPLIT_ASSERT( block_size < 65536);
+        memcpy( header, split_bgzf_eof, SPLIT_BGZF_HEADER_SIZE);
+        header[16] = block_size & 0xff;
+        header[17] = block_size >> 8;
+
+        for ( int i = 0; i < 4; i++ )
+        {
+            trailer[i] = (block->crc >> (8 * i)) & 0xff;
+            trailer[4 + i] = (data_size >> (8 * i)) & 0xff;
+        }
+    }
+}
+
+/**
+ * Thread compressing blocks
+ */
+static void split_Deflate( split_Deflater_t *deflater)
+{
+    while ( 1 )
+    {
+        split_DeflatedBlock_t *block = NULL;
+
+        {
+            std::unique_lock<std::mutex> guard( deflater->lock);
+
+            while ( !deflater->is_stopped && deflater->queue.empty() )
+            {
+                deflater->cond.wait( guard);
+            }
+
+            if ( deflater->queue.empty() )
+            {
+                return;
+            }
+
+            block = deflater->queue.front();
+            deflater->queue.pop_front();
+        }
+
+        split_DeflateBlock( deflater->compression, deflater->level, block);
+
+        std::lock_guard<std::mutex> guard( deflater->lock);
+
+        block->is_done = true;
+        deflater->cond.notify_all();
+    }
+}
+
+/**
+ * Start threads compressing output data
+ */
+static void split_StartDeflater( split_Deflater_t *deflater,
+                                 split_Compression_t compression,
+                                 int level,
+                                 int64_t num_threads)
+{
+    deflater->compression = compression;
+    deflater->level = level;
+    deflater->max_blocks = num_threads * SPLIT_DEFLATE_BLOCKS_PER_THREAD;
+    deflater->is_stopped = false;
+
+    for ( int64_t i = 0; i < num_threads; i++ )
+    {
+        deflater->threads.push_back( split_StartWorker( &deflater->lock, &deflater->cond,
+                                                        std::bind( split_Deflate,
+                                                                   deflater)));
+    }
+}
+
+/**
+ * Take the first compressed block. If "is_wait" is "true", wait for it to be
+ * compressed. Return NULL if there are no blocks or the first one is not
+ * compressed yet (and "is_wait" is "false"). The block should be deleted by
+ * the caller
+ */
+static split_DeflatedBlock_t *split_TakeDeflated( split_Deflater_t *deflater,
+                                                  bool is_wait)
+{
+    std::unique_lock<std::mutex> guard( deflater->lock);
+
+    while ( is_wait && !deflater->blocks.empty() && !deflater->blocks.front()->is_done
+            && !split_workers->is_failed )
+    {
+        deflater->cond.wait( guard);
+    }
+
+    split_CheckWorkers();
+
+    if ( deflater->blocks.empty() || !deflater->blocks.front()->is_done )
+    {
+        return NULL;
+    }
+
+    split_DeflatedBlock_t *block = deflater->blocks.front();
+
+    deflater->blocks.pop_front();
+    deflater->cond.notify_all();
+
+    return block;
+}
+
+/**
+ * Check if there is room for one more block
+ */
+static bool split_HasDeflaterRoom( split_Deflater_t *deflater)
+{
+    std::lock_guard<std::mutex> guard( deflater->lock);
+
+    return deflater->blocks.size() < deflater->max_blocks;
+}
+
+/**
+ * Queue data for compression. The data is copied, so the buffer may be reused
+ * right after the call. The caller should take compressed blocks to keep
+ * room in the queue (see "split_HasDeflaterRoom()")
+ */
+static void split_DeflateData( split_Deflater_t *deflater, const char *data, int64_t size)
+{
+    int64_t block_size = (deflater->compression == SPLIT_COMPRESSION_BGZF)
+                         ? SPLIT_BGZF_BLOCK_DATA_SIZE
+                         : SPLIT_GZIP_DEFLATE_BLOCK_SIZE;
+
+    for ( int64_t offset = 0; offset < size; offset += block_size )
+    {
+        split_DeflatedBlock_t *block = new split_DeflatedBlock_t();
+
+        block->data.assign( data + offset, data + std::min( size, offset + block_size));
+        block->is_done = false;
+
+        std::lock_guard<std::mutex> guard( deflater->lock);
+
+        deflater->blocks.push_back( block);
+        deflater->queue.push_back( block);
+        deflater->cond.notify_all();
+    }
+}
+
+/**
+ * Stop compressing threads. It may be repeated
+ */
+static void split_StopDeflater( split_Deflater_t *deflater)
+{
+    {
+        std::lock_guard<std::mutex> guard( deflater->lock);
+
+        deflater->is_stopped = true;
+        deflater->cond.notify_all();
+    }
+
+    for ( size_t i = 0; i < deflater->threads.size(); i++ )
+    {
+        deflater->threads[i].join();
+    }
+
+    for ( size_t i = 0; i < deflater->blocks.size(); i++ )
+    {
+        delete deflater->blocks[i];
+    }
+
+    deflater->threads.clear();
+    deflater->blocks.clear();
+    deflater->queue.clear();
+}
+
+/**
+ * Get data starting a compressed file
+ */
+static void split_GetDeflatedHeader( split_Compression_t compression,
+                                     std::vector<char> &header)
+{
+    header.clear();
+
+    if ( compression == SPLIT_COMPRESSION_GZIP )
+    {
+        header.assign( split_gzip_header,
+                       split_gzip_header + sizeof( split_gzip_header));
+    }
+}
+
+/**
+ * Get data ending a compressed file. "crc" and "size" are CRC32 and size of
+ * uncompressed data of the file
+ */
+static void split_GetDeflatedTrailer( split_Compression_t compression,
+                                      uLong crc,
+                                      int64_t size,
+                                      std::vector<char> &trailer)
+{
+    if ( compression == SPLIT_COMPRESSION_BGZF )
+    {
+        trailer.assign( split_bgzf_eof, split_bgzf_eof + sizeof( split_bgzf_eof));
+
+        return;
+    }
+
+    trailer.assign( split_deflate_end, split_deflate_end + sizeof( split_deflate_end));
+
+    /* Size is stored modulo 4G */
+    for ( int i = 0; i < 4; i++ )
+    {
+        trailer.push_back( (crc >> (8 * i)) & 0xff);
+    }
+
+    for ( int i = 0; i < 4; i++ )
+    {
+        trailer.push_back( (size >> (8 * i)) & 0xff);
+    }
+}
@@ -0,0 +1,384 @@
+/**
+ * Copyright © 2016 Andrey Nevolin, https://github.com/AndreyNevolin
+ * Twitter: @Andrey_Nevolin
+ * LinkedIn: https://www.linkedin.com/in/andrey-nevolin-76387328
+ *
+ * Distribution of records between output files
+ *
+ * Instead of cutting the input into contiguous pieces, records are dealt to
+ * output files one by one: in turn ("round-robin") or by a hash of the key of
+ * a record ("hash"). The key is the identifier for FASTA and FASTQ (the header
+ * up to the first whitespace, without the leading '>' or '@') and the whole
+ * record for other layouts. So records with the same identifier always land
+ * in the same file
+ *
+ * The input is cut into chunks ending at element bounds, and the chunks are
+ * dealt by a pool of threads independently of each other. A thread walks the
+ * records of a chunk and gathers records of each output file into a separate
+ * list of memory ranges, merging adjacent ranges. No data is copied and no lock
+ * is taken per record. Dealt chunks are taken in the order of the input, and
+ * the list of each output file is written by gathering writes ("writev()")
+ *
+ * In round-robin mode the number of records preceding a chunk is not known
+ * while the chunk is dealt. So records are gathered by their number inside the
+ * chunk, and lists are rotated between output files when the chunk is written
+ */
+
+/* Maximum number of chunks queued for dealing per thread */
+#define SPLIT_DEAL_CHUNKS_PER_THREAD 2
+
+/**
+ * Ways of dealing records to output files
+ */
+typedef enum
+{
+    /* Records are not dealt. The input is cut into contiguous pieces */
+    SPLIT_DISTRIBUTE_NONE,
+    /* Records are dealt in turn */
+    SPLIT_DISTRIBUTE_ROUND_ROBIN,
+    /* Records are dealt by a hash of their keys */
+    SPLIT_DISTRIBUTE_HASH
+} split_Distribution_t;
+
+/**
+ * Chunk of the input being dealt
+ */
+typedef struct
+{
+    /* Double-buffer holding the chunk. The chunk is read to its upper half,
+       and the unfinished record of the preceding chunk is put right before */
+    char *double_buff;
+    /* Chunk size the double-buffer is allocated for */
+    int64_t capacity;
+    /* Data of the chunk. It starts with a record and ends at an element
+       bound (or at the end of the input) */
+    char *data;
+    int64_t size;
+    /* Memory ranges gathered for each output file. In round-robin mode there
+       is a list for each record number inside the chunk modulo the number of
+       output files */
+    std::vector<std::vector<struct iovec> > lists;
+    /* Number of records in the chunk */
+    int64_t num_records;
+    /* Indicator that dealing of the chunk is finished */
+    bool is_done;
+} split_DealtChunk_t;
+
+/**
+ * Pool of threads dealing records of chunks to output files
+ */
+typedef struct
+{
+    split_Distribution_t distribution;
+    split_RecordLayout_t layout;
+    int64_t num_outputs;
+    /* Chunks in the order of the input. The splitting loop takes them from the
+       front when they are dealt */
+    std::deque<split_DealtChunk_t *> chunks;
+    /* Chunks not yet taken by dealing threads */
+    std::deque<split_DealtChunk_t *> queue;
+    /* Maximum number of chunks in "chunks" */
+    size_t max_chunks;
+    bool is_stopped;
+    std::mutex lock;
+    std::condition_variable cond;
+    std::vector<std::thread> threads;
+} split_Dealer_t;
+
+/**
+ * Find end of a record starting at "start". Return offset of the byte
+ * following the record, or "size" if the record ends at the end of the data
+ */
+static int64_t split_FindRecordEnd( const split_ByteSearch_t *search,
+                                    split_RecordLayout_t layout,
+                                    const char *data,
+                                    int64_t start,
+                                    int64_t size)
+{
+    const char *end = data + size;
+    const char *pos = data + start;
+
+    switch ( layout )
+    {
+        case SPLIT_LAYOUT_FASTA:
+            /* The record lasts until a header symbol starting a line */
+            while ( (pos = search->find_first( pos + 1, end, '>')) )
+            {
+                if ( pos[-1] == '\n' )
+                {
+                    return pos - data;
+                }
+            }
+
+            return size;
+
+        case SPLIT_LAYOUT_FASTQ:
+            for ( int i = 0; i < 4; i++ )
+            {
+                if ( !(pos = search->find_first( pos, end, '\n')) )
+                {
+                    return size;
+                }
+
+                pos++;
+            }
+
+            return pos - data;
+
+        case SPLIT_LAYOUT_LINES:
+            pos = search->find_first( pos, end, '\n');
+
+            return pos ? pos + 1 - data : size;
+
+        case SPLIT_LAYOUT_CSV:
+        {
+            /* Newlines inside quoted fields are preceded by an odd number of
+               quotes. Escaped quotes are doubled, so they don't change that */
+            int64_t num_quotes = 0;
+
+            while ( 1 )
+            {
+                const char *new_line = search->find_first( pos, end, '\n');
+
+                if ( !new_line )
+                {
+                    return size;
+                }
+
+                num_quotes += search->count( pos, new_line, '"');
+                pos = new_line + 1;
+
+                if ( !(num_quotes % 2) )
+                {
+                    return pos - data;
+                }
+            }
+        }
+    }
+
+    SPLIT_ASSERT( 0);
+
+    return size;
+}
+
+/**
+ * Hash the key of a record occupying bytes from "start" to "end" (exclusive).
+ * FNV-1a is used, so the hash doesn't depend on the platform or the run
+ */
+static uint64_t split_HashRecordKey( split_RecordLayout_t layout,
+                                     const char *data,
+                                     int64_t start,
+                                     int64_t end)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    if ( (layout == SPLIT_LAYOUT_FASTA) || (layout == SPLIT_LAYOUT_FASTQ) )
+    {
+        /* Skip the header symbol and stop at the first whitespace */
+        for ( int64_t i = start + 1; i < end; i++ )
+        {
+            if ( isspace( (unsigned char)data[i]) )
+            {
+                end = i;
+
+                break;
+            }
+        }
+
+        start = std::min( start + 1, end);
+    } else if ( (end > start) && (data[end - 1] == '\n') )
+    {
+        /* The last record of the input may lack the newline */
+        end--;
+    }
+
+    for ( int64_t i = start; i < end; i++ )
+    {
+        hash = (hash ^ (unsigned char)data[i]) * 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+/**
+ * Deal records of a chunk to lists of memory ranges
+ */
+static void split_DealChunk( const split_Dealer_t *dealer, split_DealtChunk_t *chunk)
+{
+    const split_ByteSearch_t *search = split_GetByteSearch();
+    int64_t list_num = 0;
+
+    chunk->lists.resize( dealer->num_outputs);
+    chunk->num_records = 0;
+
+    for ( int64_t i = 0; i < dealer->num_outputs; i++ )
+    {
+        chunk->lists[i].clear();
+    }
+
+    for ( int64_t start = 0; start < chunk->size; )
+    {
+        int64_t end = split_FindRecordEnd( search, dealer->layout, chunk->data, start,
+                                           chunk->size);
+
+        if ( dealer->distribution == SPLIT_DISTRIBUTE_HASH )
+        {
+            list_num = split_HashRecordKey( dealer->layout, chunk->data, start, end)
+                       % dealer->num_outputs;
+        }
+
+        std::vector<struct iovec> & list = chunk->lists[list_num];
+
+        /* Merge with the preceding range if the record continues it */
+        if ( !list.empty()
+             && ((char *)list.back().iov_base + list.back().iov_len
+                 == chunk->data + start) )
+        {
+            list.back().iov_len += end - start;
+        } else
+        {
+            struct iovec range = {chunk->data + start, (size_t)(end - start)};
+
+            list.push_back( range);
+        }
+
+        if ( (dealer->distribution == SPLIT_DISTRIBUTE_ROUND_ROBIN)
+             && (++list_num == dealer->num_outputs) )
+        {
+            list_num = 0;
+        }
+
+        chunk->num_records++;
+        start = end;
+    }
+}
+
+/**
+ * Thread dealing chunks
+ */
+static void split_Deal( split_Dealer_t *dealer)
+{
+    while ( 1 )
+    {
+        split_DealtChunk_t *chunk = NULL;
+
+        {
+            std::unique_lock<std::mutex> guard( dealer->lock);
+
+            while ( !dealer->is_stopped && dealer->queue.empty() )
+            {
+                dealer->cond.wait( guard);
+            }
+
+            if ( dealer->queue.empty() )
+            {
+                return;
+            }
+
+            chunk = dealer->queue.front();
+            dealer->queue.pop_front();
+        }
+
+        split_DealChunk( dealer, chunk);
+
+        std::lock_guard<std::mutex> guard( dealer->lock);
+
+        chunk->is_done = true;
+        dealer->cond.notify_all();
+    }
+}
+
+/**
+ * Start threads dealing records
+ */
+static void split_StartDealer( split_Dealer_t *dealer,
+                               split_Distribution_t distribution,
+                               split_RecordLayout_t layout,
+                               int64_t num_outputs,
+                               int64_t num_threads)
+{
+    dealer->distribution = distribution;
+    dealer->layout = layout;
+    dealer->num_outputs = num_outputs;
+    dealer->max_chunks = num_threads * SPLIT_DEAL_CHUNKS_PER_THREAD;
+    dealer->is_stopped = false;
+
+    for ( int64_t i = 0; i < num_threads; i++ )
+    {
+        dealer->threads.push_back( split_StartWorker( &dealer->lock, &dealer->cond,
+                                                      std::bind( split_Deal, dealer)));
+    }
+}
+
+/**
+ * Check if there is room for one more chunk
+ */
+static bool split_HasDealerRoom( split_Dealer_t *dealer)
+{
+    std::lock_guard<std::mutex> guard( dealer->lock);
+
+    return dealer->chunks.size() < dealer->max_chunks;
+}
+
+/**
+ * Queue a chunk for dealing. The chunk should not be touched until it's taken
+ * back (see "split_TakeDealt()")
+ */
+static void split_DealData( split_Dealer_t *dealer, split_DealtChunk_t *chunk)
+{
+    std::lock_guard<std::mutex> guard( dealer->lock);
+
+    chunk->is_done = false;
+    dealer->chunks.push_back( chunk);
+    dealer->queue.push_back( chunk);
+    dealer->cond.notify_all();
+}
+
+/**
+ * Take the first chunk, waiting for it to be dealt. Return NULL if there are
+ * no chunks
+ */
+static split_DealtChunk_t *split_TakeDealt( split_Dealer_t *dealer)
+{
+    std::unique_lock<std::mutex> guard( dealer->lock);
+
+    while ( !dealer->chunks.empty() && !dealer->chunks.front()->is_done
+            && !split_workers->is_failed )
+    {
+        dealer->cond.wait( guard);
+    }
+
+    split_CheckWorkers();
+
+    if ( dealer->chunks.empty() )
+    {
+        return NULL;
+    }
+
+    split_DealtChunk_t *chunk = dealer->chunks.front();
+
+    dealer->chunks.pop_front();
+
+    return chunk;
+}
+
+/**
+ * Stop dealing threads. Chunks still queued are left to the caller. It may
+ * be repeated
+ */
+static void split_StopDealer( split_Dealer_t *dealer)
+{
+    {
+        std::lock_guard<std::mutex> guard( dealer->lock);
+
+        dealer->is_stopped = true;
+        dealer->cond.notify_all();
+    }
+
+    for ( size_t i = 0; i < dealer->threads.size(); i++ )
+    {
+        dealer->threads[i].join();
+    }
+
+    dealer->threads.clear();
+}
@@ -0,0 +1,321 @@
+/**
+ * Copyright © 2016 Andrey Nevolin, https://github.com/AndreyNevolin
+ * Twitter: @Andrey_Nevolin
+ * LinkedIn: https://www.linkedin.com/in/andrey-nevolin-76387328
+ *
+ * Bound finders for FASTA files (FASTA is a bioinformatics format for
+ * representing nucleotide or peptide sequences). The reference one,
+ * "split_FindBoundScalar()", recognizes the simplest version of the format:
+ * ">IDENTIFIER\n"
+ * "SEQUENCE\n"
+ *
+ * It also defines the interface of all bound finders of the tool. To split
+ * files of a different format, one needs to implement a function with the
+ * same arguments and return value, and register it in "formats.cpp"
+ *
+ * There are two versions of the search. "split_FindBoundScalar()" walks
+ * the buffer byte-by-byte and is kept as the reference. The version actually
+ * used by the tool skips over data with the vectorized byte search and
+ * returns exactly the same bounds. The vectorized version also handles FASTA
+ * with sequences split into several lines
+ */
+
+/**
+ * Find actual bound of an element inside a buffer. The actual bound
+ * should preferably be close to a projected bound
+ *
+ * Input: buff - pointer to the buffer
+ *        projected_bound - desired offset of an element's last byte
+ *        buff_size - buffer size
+ *        is_first_block - indicator that a new output file will be started
+ *                         with the data in the buffer (i.e. we're going
+ *                         to write first chunk of the file)
+ *
+ * Return value: offset relative to "buff" if element bound was found, or
+ *               SPLIT_BOUND_NOT_FOUND in the opposite case.
+ *               "offset" should be from "-1" to "buff_size - 1".
+ *               "-1" means that first byte of "buff" concides with first
+ *               byte of some element and we want to finish current output
+ *               file without adding any "buff" contents to it. This implies
+ *               that the output file already contains an integer number of
+ *               "elements". This is only possible when we don't start a
+ *               new output file but continue adding data to already
+ *               existing one. So, returning "-1" is only allowed when
+ *               "is_first_block" indicator is "false". This is exactly the
+ *               reason of having this indicator among the parameters: to
+ *               allow to not add more data to an output file. Consider an
+ *               example: buffer contents starts with a new element of
+ *               size 100, projected bound is 10. The choice is adding 89
+ *               to the desired size vs. subtracting 11. Subtracting 11
+ *               might result in a better balancing of output file sizes
+ */
+int64_t split_FindBoundScalar( const char * const buff,
+                               int64_t projected_bound,
+                               int64_t buff_size,
+                               bool is_first_block)
+{
+    /* Check that the desired bound falls inside the buffer */
+    SPLIT_ASSERT( projected_bound >= 0);
+    SPLIT_ASSERT( projected_bound < buff_size);
+
+    int64_t distance_to_l_bound = projected_bound + 1;
+    int64_t distance_to_u_bound = buff_size - projected_bound;
+    char num_new_lines = 0, right_symb = 0, left_symb = 0;
+
+    /* Seek from the desired bound byte-by-byte to left and right simultaneously.
+       Stop when we find an element bound. This bound is guaranteed to be the
+       closest to the desired bound. We check left byte before the right one,
+       because it's preferrable for us to have output files that are smaller than
+       projected. That's becasue the last output file is generally expected to be
+       smaller than other pieces. Keeping other pieces smaller might result in a
+       bigger last file and - hence - in better size balancing (though it's still
+       just a heuristic) */
+    for ( int64_t i = 0; i < std::max( distance_to_l_bound, distance_to_u_bound); i++ )
+    {
+        if ( i >= distance_to_l_bound )
+        {
+            /* Shouldn't seek left to the left bound. So, use arbitrary symbol
+               which is not equal to the element start symbol */
+            left_symb = 'a';
+        } else
+        {
+            left_symb = buff[projected_bound - i];
+        }
+
+        if ( i >= distance_to_u_bound )
+        {
+            /* Shouldn't seek right to the right bound. So, use arbitrary symbol
+               which is not equal to the element start symbol */
+            right_symb = 'a';
+        } else
+        {
+            right_symb = buff[projected_bound + i];
+        }
+
+        /* Element start symbol found */
+        if ( left_symb == '>' )
+        {
+            if ( (i < distance_to_l_bound - 1) || !is_first_block )
+            {
+                /* Return previous symbol only in case when current buffer
+                   contents is not intended to start new output file */
+                return projected_bound - i - 1;
+            }
+        }
+
+        /* Element start symbol found */
+        if ( (right_symb == '>') && (i != 0) )
+        {
+            /* Return previous symbol only in case when it doesn't coinside
+               with the projected bound (if it does that means that this
+               bound doesn't work for us, because otherwise we wouldn't
+               reach this condition. The condition on "left_symb" above
+               would "return" in this case) */
+            return projected_bound + i - 1;
+        }
+
+        if ( left_symb == '\n' )
+        {
+            num_new_lines++;
+        }
+
+        if ( (right_symb == '\n') && (i != 0) )
+        {
+            num_new_lines++;
+        }
+
+        /* Each element should have exactly two newlines. So, if we detected
+           two newlines, the 'upper' one may be used as an element bound. But
+           here we use a stronger condition: we reached upper bound of the
+           buffer and it represents the second newline (i.e. last byte of the
+           buffer conicides with an end of some element */
+        if ( (num_new_lines == 2) && (i >= distance_to_u_bound - 1)
+             && (buff[buff_size - 1] == '\n') )
+        {
+            return buff_size - 1;
+        }
+
+        SPLIT_ASSERT( num_new_lines <= 2);
+    }
+
+    return SPLIT_BOUND_NOT_FOUND;
+}
+
+/**
+ * Width of the strip searched at the first step of the vectorized search.
+ * Doubled at each subsequent step
+ */
+#define SPLIT_FIND_BOUND_STEP_MIN 256
+
+/**
+ * Find actual bound of an element inside a buffer using the given
+ * implementation of the byte search. If "IS_TWO_LINE" is "true", the result
+ * is the same as the one of "split_FindBoundScalar()". Otherwise sequences
+ * may span several lines, and only element start symbols are looked for
+ *
+ * The byte-by-byte search stops at the element start symbol closest to the
+ * projected bound (preferring the left one on ties), unless the rule of two
+ * newlines fires earlier. Here the closest element start symbol is looked
+ * for in strips growing outward from the projected bound. Then the step at
+ * which the byte-by-byte search would have counted two newlines is
+ * calculated, and the two candidates are compared
+ */
+template <bool IS_TWO_LINE>
+int64_t split_FindBoundVector( const split_ByteSearch_t *search,
+                               const char * const buff,
+                               int64_t projected_bound,
+                               int64_t buff_size,
+                               bool is_first_block)
+{
+    /* Check that the desired bound falls inside the buffer */
+    SPLIT_ASSERT( projected_bound >= 0);
+    SPLIT_ASSERT( projected_bound < buff_size);
+
+    int64_t distance_to_l_bound = projected_bound + 1;
+    int64_t distance_to_u_bound = buff_size - projected_bound;
+    int64_t max_distance = std::max( distance_to_l_bound, distance_to_u_bound);
+    /* Element start symbol at offset "0" is useless if the buffer starts a new
+       output file */
+    int64_t l_limit = is_first_block ? 1 : 0;
+    /* Distance from the projected bound to the closest element start symbol
+       and the bound that symbol gives */
+    int64_t start_distance = -1;
+    int64_t start_bound = SPLIT_BOUND_NOT_FOUND;
+
+    /* All bytes closer to the projected bound than "reach" are already
+       checked */
+    for ( int64_t reach = 0, width = SPLIT_FIND_BOUND_STEP_MIN;
+          (reach < max_distance) && (start_distance == -1);
+          reach += width, width *= 2 )
+    {
+        int64_t new_reach = std::min( reach + width, max_distance);
+        int64_t l_begin = std::max( projected_bound - new_reach + 1, l_limit);
+        int64_t l_end = projected_bound - reach + 1;
+        /* The byte at the projected bound itself is never an element start
+           when seeking right */
+        int64_t r_begin = projected_bound + std::max( reach, (int64_t)1);
+        int64_t r_end = std::min( projected_bound + new_reach, buff_size);
+        const char *left = NULL, *right = NULL;
+
+        if ( l_begin < l_end )
+        {
+            left = search->find_last( buff + l_begin, buff + l_end, '>');
+        }
+
+        if ( r_begin < r_end )
+        {
+            right = search->find_first( buff + r_begin, buff + r_end, '>');
+        }
+
+        if ( left && (!right || (buff + projected_bound - left
+                                 <= right - buff - projected_bound)) )
+        {
+            start_distance = buff + projected_bound - left;
+            start_bound = left - buff - 1;
+        } else if ( right )
+        {
+            start_distance = right - buff - projected_bound;
+            start_bound = right - buff - 1;
+        }
+    }
+
+    /* The rule of two newlines is checked only after the upper bound of the
+       buffer is reached. So, it can't win against an element start symbol
+       found before that */
+    if ( !IS_TWO_LINE
+         || (start_distance != -1 && start_distance <= distance_to_u_bound - 1)
+         || (buff[buff_size - 1] != '\n') )
+    {
+        return start_bound;
+    }
+
+    /* Count newlines the byte-by-byte search would see by the time it reaches
+       the upper bound of the buffer. Counting beyond three is useless */
+    int64_t l_edge = projected_bound - std::min( distance_to_u_bound - 1,
+                                                 distance_to_l_bound - 1);
+    const char *end = buff + buff_size;
+    int64_t num_new_lines = 0;
+
+    while ( num_new_lines <= 2 )
+    {
+        end = search->find_last( buff + projected_bound + 1, end, '\n');
+
+        if ( !end )
+        {
+            break;
+        }
+
+        num_new_lines++;
+    }
+
+    end = buff + projected_bound + 1;
+
+    while ( num_new_lines <= 2 )
+    {
+        end = search->find_last( buff + l_edge, end, '\n');
+
+        if ( !end )
+        {
+            break;
+        }
+
+        num_new_lines++;
+    }
+
+    /* Step at which the byte-by-byte search counts exactly two newlines */
+    int64_t new_lines_distance = -1;
+
+    if ( num_new_lines == 2 )
+    {
+        new_lines_distance = distance_to_u_bound - 1;
+    } else if ( num_new_lines < 2 )
+    {
+        /* Continue seeking left only */
+        const char *new_line = buff + l_edge;
+
+        while ( new_line && num_new_lines < 2 )
+        {
+            new_line = search->find_last( buff, new_line, '\n');
+            num_new_lines++;
+        }
+
+        if ( new_line )
+        {
+            new_lines_distance = buff + projected_bound - new_line;
+        }
+    }
+
+    if ( (new_lines_distance != -1)
+         && (start_distance == -1 || new_lines_distance < start_distance) )
+    {
+        return buff_size - 1;
+    }
+
+    return start_bound;
+}
+
+/**
+ * Find actual bound of an element inside a buffer of two-line FASTA. See
+ * description of "split_FindBoundScalar()" for the details
+ */
+int64_t split_FindFastaBound( const char * const buff,
+                              int64_t projected_bound,
+                              int64_t buff_size,
+                              bool is_first_block)
+{
+    return split_FindBoundVector<true>( split_GetByteSearch(), buff, projected_bound,
+                                        buff_size, is_first_block);
+}
+
+/**
+ * Find actual bound of an element inside a buffer of multi-line FASTA. The
+ * bound is always placed before an element start symbol
+ */
+int64_t split_FindMultiLineFastaBound( const char * const buff,
+                                       int64_t projected_bound,
+                                       int64_t buff_size,
+                                       bool is_first_block)
+{
+    return split_FindBoundVector<false>( split_GetByteSearch(), buff, projected_bound,
+                                         buff_size, is_first_block);
+}
@@ -0,0 +1,120 @@
+/**
+ * Copyright © 2016 Andrey Nevolin, https://github.com/AndreyNevolin
+ * Twitter: @Andrey_Nevolin
+ * LinkedIn: https://www.linkedin.com/in/andrey-nevolin-76387328
+ *
+ * Bound finder policy for FASTQ files (FASTQ is a bioinformatics format for
+ * representing nucleotide sequences together with quality scores). The policy
+ * recognizes records of four lines:
+ * "@IDENTIFIER\n"
+ * "SEQUENCE\n"
+ * "+[IDENTIFIER]\n"
+ * "QUALITY\n"
+ *
+ * Unlike FASTA, the record start symbol '@' may also start a quality line
+ * (and so may '+'). So a line starting with '@' is accepted as a record start
+ * only after the four-line structure of the record is verified: the third
+ * line starts with '+', and the quality line is as long as the sequence line.
+ * The record is verified forward from its start, or backward from the end of
+ * the preceding record if the record itself doesn't fit into the buffer.
+ * Multi-line sequences and qualities are not supported
+ *
+ * The policy is used with the finder for line-oriented formats defined in
+ * "find_bound_lines.cpp"
+ */
+
+/**
+ * Check that a record starting right after the newline at offset "new_line"
+ * is followed by the four-line structure of a FASTQ record
+ */
+static bool split_IsFastqRecordAfter( const split_ByteSearch_t *search,
+                                      const char * const buff,
+                                      int64_t new_line,
+                                      int64_t buff_size)
+{
+    int64_t ends[5] = {new_line, -1, -1, -1, -1};
+
+    if ( (new_line + 1 >= buff_size) || (buff[new_line + 1] != '@') )
+    {
+        return false;
+    }
+
+    for ( int i = 1; i < 5; i++ )
+    {
+        ends[i] = split_FindLineEnd( search, buff, ends[i - 1] + 1, buff_size);
+
+        if ( ends[i] == -1 )
+        {
+            return false;
+        }
+
+        /* Separator line. It must start inside the buffer */
+        if ( (i == 2) && ((ends[i] + 1 >= buff_size) || (buff[ends[i] + 1] != '+')) )
+        {
+            return false;
+        }
+    }
+
+    /* Sequence and quality lines are of the same length */
+    return ends[2] - ends[1] == ends[4] - ends[3];
+}
+
+/**
+ * Check that the newline at offset "new_line" ends a FASTQ record, i.e. that
+ * it's preceded by the four-line structure of a record
+ */
+static bool split_IsFastqRecordBefore( const split_ByteSearch_t *search,
+                                       const char * const buff,
+                                       int64_t new_line)
+{
+    int64_t ends[5] = {-1, -1, -1, -1, new_line};
+
+    for ( int i = 3; i >= 0; i-- )
+    {
+        /* The newline preceding the identifier line is required too. Without
+           it the line might be a tail of some other line */
+        ends[i] = split_FindLineStart( search, buff, ends[i + 1]);
+
+        if ( ends[i] == -1 )
+        {
+            return false;
+        }
+    }
+
+    return (buff[ends[0] + 1] == '@') && (buff[ends[2] + 1] == '+')
+           && (ends[2] - ends[1] == ends[4] - ends[3]);
+}
+
+/**
+ * FASTQ policy. A newline is a bound if it's followed by '@' (or by the end of
+ * the buffer), and the four-line structure of a record is seen after or before
+ * it
+ */
+class split_FastqPolicy
+{
+public:
+    split_FastqPolicy( const split_ByteSearch_t *search,
+                       const char *buff,
+                       int64_t projected_bound,
+                       int64_t buff_size,
+                       bool is_first_block)
+        : search( search), buff( buff), buff_size( buff_size)
+    {
+    }
+
+    bool IsBound( int64_t new_line)
+    {
+        if ( (new_line + 1 < buff_size) && (buff[new_line + 1] != '@') )
+        {
+            return false;
+        }
+
+        return split_IsFastqRecordAfter( search, buff, new_line, buff_size)
+               || split_IsFastqRecordBefore( search, buff, new_line);
+    }
+
+private:
+    const split_ByteSearch_t *search;
+    const char *buff;
+    int64_t buff_size;
+};
@@ -0,0 +1,257 @@
+/**
+ * Copyright © 2016 Andrey Nevolin, https://github.com/AndreyNevolin
+ * Twitter: @Andrey_Nevolin
+ * LinkedIn: https://www.linkedin.com/in/andrey-nevolin-76387328
+ *
+ * Bound finders for line-oriented formats. In such formats an element bound
+ * is always a newline, but not every newline is an element bound. The finder
+ * visits newlines in the order of their distance from the projected bound
+ * and asks a format policy whether a newline is a bound
+ *
+ * A policy is a class constructed once per search:
+ *     Policy( const split_ByteSearch_t *search, const char *buff,
+ *             int64_t projected_bound, int64_t buff_size, bool is_first_block)
+ * and providing a method:
+ *     bool IsBound( int64_t new_line)
+ * The finder is a template instantiated for each policy, so the policy is
+ * inlined into the search loop
+ *
+ * The first byte of a buffer can't be recognized as a start of an element,
+ * because the byte preceding it is not known. So these finders never return
+ * "-1"
+ */
+
+/**
+ * If a bound is found farther than this fraction of the buffer from the
+ * projected bound, a warning is printed: elements may soon stop fitting into
+ * a chunk
+ */
+#define SPLIT_FAR_SCAN_DIVISOR 4
+
+/**
+ * Find end of a line. Return offset of the newline ending the line that
+ * starts at "line_start", or "-1" if the line doesn't end inside the buffer
+ */
+static inline int64_t split_FindLineEnd( const split_ByteSearch_t *search,
+                                         const char * const buff,
+                                         int64_t line_start,
+                                         int64_t buff_size)
+{
+    const char *new_line = search->find_first( buff + line_start, buff + buff_size,
+                                               '\n');
+
+    return new_line ? new_line - buff : -1;
+}
+
+/**
+ * Find start of a line. Return offset of the newline preceding the line that
+ * ends at "line_end", or "-1" if there is no such newline inside the buffer
+ */
+static inline int64_t split_FindLineStart( const split_ByteSearch_t *search,
+                                           const char * const buff,
+                                           int64_t line_end)
+{
+    const char *new_line = search->find_last( buff, buff + line_end, '\n');
+
+    return new_line ? new_line - buff : -1;
+}
+
+/**
+ * Find actual bound of an element inside a buffer of a line-oriented format.
+ * See description of "split_FindBoundScalar()" for the details on arguments
+ * and return value
+ */
+template <typename Policy>
+int64_t split_FindLineBound( const char * const buff,
+                             int64_t projected_bound,
+                             int64_t buff_size,
+                             bool is_first_block)
+{
+    /* Check that the desired bound falls inside the buffer */
+    SPLIT_ASSERT( projected_bound >= 0);
+    SPLIT_ASSERT( projected_bound < buff_size);
+
+    const split_ByteSearch_t *search = split_GetByteSearch();
+    Policy policy( search, buff, projected_bound, buff_size, is_first_block);
+    /* Closest newlines to the left (including the projected bound itself) and
+       to the right of the projected bound which are not checked yet */
+    int64_t left = split_FindLineStart( search, buff, projected_bound + 1);
+    int64_t right = split_FindLineEnd( search, buff, projected_bound + 1, buff_size);
+    int64_t bound = SPLIT_BOUND_NOT_FOUND;
+
+    /* Check newlines in the order of their distance from the projected bound.
+       The left one goes first on ties, for the same reason as in the FASTA
+       finder */
+    while ( left != -1 || right != -1 )
+    {
+        if ( (left != -1)
+             && ((right == -1) || (projected_bound - left <= right - projected_bound)) )
+        {
+            if ( policy.IsBound( left) )
+            {
+                bound = left;
+
+                break;
+            }
+
+            left = split_FindLineStart( search, buff, left);
+        } else
+        {
+            if ( policy.IsBound( right) )
+            {
+                bound = right;
+
+                break;
+            }
+
+            right = split_FindLineEnd( search, buff, right + 1, buff_size);
+        }
+    }
+
+    /* Warn once per split if elements are about to become too long for the
+       chunk size */
+    int64_t scan_distance = (bound == SPLIT_BOUND_NOT_FOUND) ? buff_size
+                                                             : std::abs( bound
+                                                                         - projected_bound);
+
+    if ( (scan_distance > buff_size / SPLIT_FAR_SCAN_DIVISOR)
+         && !split_messages->is_far_scan_reported.exchange( true) )
+    {
+        SPLIT_OUT( "Warning: element bound was searched %ld bytes away from the "
+                   "projected bound in a buffer of %ld bytes. Consider increasing "
+                   "chunk size (\"--cs\")", scan_distance, buff_size);
+    }
+
+    return bound;
+}
+
+/**
+ * Newline-delimited formats (NDJSON, TSV, plain text): each line is an
+ * element, so each newline is a bound
+ */
+class split_LinePolicy
+{
+public:
+    split_LinePolicy( const split_ByteSearch_t *search,
+                      const char *buff,
+                      int64_t projected_bound,
+                      int64_t buff_size,
+                      bool is_first_block)
+    {
+    }
+
+    bool IsBound( int64_t new_line)
+    {
+        return true;
+    }
+};
+
+/**
+ * CSV: each line is an element, except that a quoted field may contain
+ * newlines. A newline is a bound if it's outside of quotes. Escaped quotes
+ * inside quoted fields are doubled, so whether a position is inside quotes is
+ * given by parity of the number of quotes before it, provided that the state
+ * at the beginning of the buffer is known
+ *
+ * If the buffer starts a new piece, it starts with an element, so the state is
+ * "outside of quotes". Otherwise the state is deduced from the first quote
+ * that is definitely opening (it follows a field separator and doesn't precede
+ * one) or definitely closing (vice versa). If there is no such quote, the
+ * buffer is assumed to start outside of quotes. So quoted fields with embedded
+ * newlines are expected to be shorter than a chunk
+ */
+class split_CsvPolicy
+{
+public:
+    split_CsvPolicy( const split_ByteSearch_t *search,
+                     const char *buff,
+                     int64_t projected_bound,
+                     int64_t buff_size,
+                     bool is_first_block)
+        : search( search), buff( buff)
+    {
+        is_quoted_at_start = !is_first_block && IsQuotedAtStart( buff_size);
+        left_offset = right_offset = projected_bound + 1;
+        left_quotes = right_quotes = search->count( buff, buff + left_offset, '"');
+    }
+
+    bool IsBound( int64_t new_line)
+    {
+        int64_t quotes = 0;
+
+        /* Newlines are visited outward from the projected bound. So quotes are
+           counted incrementally on both sides */
+        if ( new_line < left_offset )
+        {
+            left_quotes -= search->count( buff + new_line, buff + left_offset, '"');
+            left_offset = new_line;
+            quotes = left_quotes;
+        } else
+        {
+            right_quotes += search->count( buff + right_offset, buff + new_line, '"');
+            right_offset = new_line;
+            quotes = right_quotes;
+        }
+
+        return is_quoted_at_start == (quotes % 2 == 1);
+    }
+
+private:
+    /**
+     * Check if a byte is a separator of CSV fields
+     */
+    static bool IsSeparator( char c)
+    {
+        return (c == ',') || (c == '\n') || (c == '\r');
+    }
+
+    /**
+     * Deduce whether the buffer starts inside a quoted field
+     */
+    bool IsQuotedAtStart( int64_t buff_size)
+    {
+        const char *quote = buff;
+        int64_t num_quotes = 0;
+
+        while ( (quote = search->find_first( quote, buff + buff_size, '"')) )
+        {
+            /* Quotes at the edges of the buffer can't be classified */
+            if ( (quote == buff) || (quote + 1 == buff + buff_size) )
+            {
+                num_quotes++;
+                quote++;
+
+                continue;
+            }
+
+            char prev = quote[-1];
+            char next = quote[1];
+
+            /* Opening quote. The state before it is "outside of quotes" */
+            if ( IsSeparator( prev) && !IsSeparator( next) && (next != '"') )
+            {
+                return num_quotes % 2 == 1;
+            }
+
+            /* Closing quote. The state before it is "inside of quotes" */
+            if ( IsSeparator( next) && !IsSeparator( prev) && (prev != '"') )
+            {
+                return num_quotes % 2 == 0;
+            }
+
+            num_quotes++;
+            quote++;
+        }
+
+        return false;
+    }
+
+    const split_ByteSearch_t *search;
+    const char *buff;
+    /* State at the beginning of the buffer */
+    bool is_quoted_at_start;
+    /* Number of quotes before the leftmost and the rightmost visited
+       positions */
+    int64_t left_offset, left_quotes;
+    int64_t right_offset, right_quotes;
+};
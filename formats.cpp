@@ -0,0 +1,68 @@
+/**
+ * Copyright © 2016 Andrey Nevolin, https://github.com/AndreyNevolin
+ * Twitter: @Andrey_Nevolin
+ * LinkedIn: https://www.linkedin.com/in/andrey-nevolin-76387328
+ *
+ * Registry of file formats supported by the tool. The format is selected at
+ * run time with the "--format" option
+ *
+ * To add a format, implement a bound finder with the interface described in
+ * "find_bound_fasta.cpp" and add it to "split_formats" together with the
+ * layout of its records. For a line-oriented format it's enough to implement a
+ * policy for "split_FindLineBound()" (see "find_bound_lines.cpp"). Then
+ * describe the format in the help message
+ */
+
+/**
+ * Find actual bound of an element inside a buffer. See description of
+ * "split_FindBoundScalar()" for the details
+ */
+typedef int64_t (*split_FindBound_t)( const char * const buff,
+                                      int64_t projected_bound,
+                                      int64_t buff_size,
+                                      bool is_first_block);
+
+/**
+ * File format
+ */
+typedef struct
+{
+    /* Name used in the "--format" option */
+    const char *name;
+    /* Bound finder. It's called once per bound search, so the call is never
+       made per byte of data */
+    split_FindBound_t find_bound;
+    /* Layout of records. Used to weigh data when pieces are balanced by the
+       number of records or residues (see "weigh.cpp"), and to walk records
+       when they are distributed between output files (see "distribute.cpp") */
+    split_RecordLayout_t layout;
+} split_Format_t;
+
+/**
+ * All supported formats. The first one is the default
+ */
+static const split_Format_t split_formats[] =
+{
+    {"fasta",           split_FindFastaBound,                   SPLIT_LAYOUT_FASTA},
+    {"fasta-multiline", split_FindMultiLineFastaBound,          SPLIT_LAYOUT_FASTA},
+    {"fastq",           split_FindLineBound<split_FastqPolicy>, SPLIT_LAYOUT_FASTQ},
+    {"lines",           split_FindLineBound<split_LinePolicy>,  SPLIT_LAYOUT_LINES},
+    {"csv",             split_FindLineBound<split_CsvPolicy>,   SPLIT_LAYOUT_CSV},
+    {0,                 0,                                      SPLIT_LAYOUT_LINES}
+};
+
+/**
+ * Find format by name. Return NULL if there is no such format
+ */
+static const split_Format_t *split_FindFormat( const char *name)
+{
+    for ( const split_Format_t *format = split_formats; format->name; format++ )
+    {
+        if ( !strcmp( format->name, name) )
+        {
+            return format;
+        }
+    }
+
+    return NULL;
+}
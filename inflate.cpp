@@ -0,0 +1,566 @@
+/**
+ * Copyright © 2016 Andrey Nevolin, https://github.com/AndreyNevolin
+ * Twitter: @Andrey_Nevolin
+ * LinkedIn: https://www.linkedin.com/in/andrey-nevolin-76387328
+ *
+ * Decompression of gzip and BGZF input files
+ *
+ * BGZF (the format of compressed BAM, VCF and FASTQ files in bioinformatics)
+ * is a series of independent gzip members of at most 64K of data each. Every
+ * member records its compressed size in the header and its uncompressed size
+ * in the trailer. So blocks may be read sequentially and decompressed by a
+ * pool of threads, and the total size of decompressed data may be found
+ * without decompressing anything
+ *
+ * Plain gzip can only be decompressed sequentially. A single thread does that
+ * ahead of the splitting loop
+ *
+ * In both cases decompressed data is produced as a queue of blocks kept in
+ * the order of the input. The splitting loop reads the data from the queue
+ * as if it was reading a file
+ */
+
+#include <zlib.h>
+
+/**
+ * Compression of input files
+ */
+typedef enum
+{
+    SPLIT_COMPRESSION_NONE,
+    SPLIT_COMPRESSION_GZIP,
+    SPLIT_COMPRESSION_BGZF
+} split_Compression_t;
+
+/* Size of the fixed part of a BGZF block header, including the extra field */
+#define SPLIT_BGZF_HEADER_SIZE 18
+/* Size of a gzip member trailer (CRC32 and size of uncompressed data) */
+#define SPLIT_GZIP_TRAILER_SIZE 8
+/* Maximum number of decompressed blocks kept in memory per thread */
+#define SPLIT_BGZF_BLOCKS_PER_THREAD 16
+/* Size of blocks produced by the plain gzip decompressor */
+#define SPLIT_GZIP_BLOCK_SIZE (1024 * 1024)
+/* Maximum number of decompressed blocks of plain gzip kept in memory */
+#define SPLIT_GZIP_MAX_BLOCKS 4
+
+/**
+ * Block of decompressed data
+ */
+typedef struct
+{
+    std::vector<char> data;
+    /* Indicator that decompression of the block is finished */
+    bool is_done;
+} split_InflatedBlock_t;
+
+/**
+ * Decompressor of an input file
+ */
+typedef struct
+{
+    int fd;
+    split_Compression_t compression;
+    /* Decompressed blocks in the order of the input. The splitting loop
+       consumes the first one */
+    std::deque<split_InflatedBlock_t *> blocks;
+    /* Maximum number of blocks in the queue */
+    size_t max_blocks;
+    /* Amount of data consumed from the first block */
+    size_t offset;
+    /* Indicator that all blocks were read from the input file */
+    bool is_input_end;
+    /* Indicator that the decompressed data is not needed anymore */
+    bool is_stopped;
+    std::mutex lock;
+    std::condition_variable cond;
+    std::vector<std::thread> threads;
+} split_Inflater_t;
+
+/**
+ * Detect compression of a file by its first bytes
+ */
+static split_Compression_t split_DetectCompression( int fd)
+{
+    unsigned char header[SPLIT_BGZF_HEADER_SIZE];
+    int64_t header_size = pread( fd, header, sizeof( header), 0);
+
+    /* gzip magic number and "deflate" compression method */
+    if ( (header_size < 10) || (header[0] != 0x1f) || (header[1] != 0x8b)
+         || (header[2] != 8) )
+    {
+        return SPLIT_COMPRESSION_NONE;
+    }
+
+    /* BGZF has an extra field with "BC" subfield of length 2 */
+    if ( (header_size == SPLIT_BGZF_HEADER_SIZE) && (header[3] & 4)
+         && (header[12] == 'B') && (header[13] == 'C') && (header[14] == 2)
+         && (header[15] == 0) )
+    {
+        return SPLIT_COMPRESSION_BGZF;
+    }
+
+    return SPLIT_COMPRESSION_GZIP;
+}
+
+/**
+ * Read exactly "size" bytes from a file. Return "false" if the file ends
+ * before any data is read. Abort if it ends in the middle
+ */
+static bool split_ReadCompressed( int fd, unsigned char *buff, int64_t size)
+{
+    char err_msg[500];
+    int64_t bytes_read = 0;
+
+    while ( bytes_read < size )
+    {
+        int64_t res = read( fd, buff + bytes_read, size - bytes_read);
+
+        if ( res == -1 )
+        {
+            if ( errno == EINTR )
+            {
+                continue;
+            }
+
+            SPLIT_ERROR( "Cannot read data from the input file: %s",
+                         SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+        } else if ( !res )
+        {
+            break;
+        }
+
+        bytes_read += res;
+    }
+
+    if ( bytes_read && (bytes_read != size) )
+    {
+        SPLIT_ERROR( "Compressed input file is truncated");
+    }
+
+    return bytes_read != 0;
+}
+
+/**
+ * Read next BGZF block. Return "false" at the end of the file
+ */
+static bool split_ReadBgzfBlock( int fd, std::vector<unsigned char> &block)
+{
+    block.resize( SPLIT_BGZF_HEADER_SIZE);
+
+    if ( !split_ReadCompressed( fd, &block[0], SPLIT_BGZF_HEADER_SIZE) )
+    {
+        return false;
+    }
+
+    if ( (block[0] != 0x1f) || (block[1] != 0x8b) || (block[12] != 'B')
+         || (block[13] != 'C') )
+    {
+        SPLIT_ERROR( "Invalid BGZF block header in the input file");
+    }
+
+    /* Total size of the block minus 1 */
+    int64_t block_size = (block[16] | (block[17] << 8)) + 1;
+
+    if ( block_size < SPLIT_BGZF_HEADER_SIZE + SPLIT_GZIP_TRAILER_SIZE )
+    {
+        SPLIT_ERROR( "Invalid BGZF block size in the input file");
+    }
+
+    block.resize( block_size);
+
+    if ( !split_ReadCompressed( fd, &block[SPLIT_BGZF_HEADER_SIZE],
+                                block_size - SPLIT_BGZF_HEADER_SIZE) )
+    {
+        SPLIT_ERROR( "Compressed input file is truncated");
+    }
+
+    return true;
+}
+
+/**
+ * Get size of uncompressed data of a gzip member from its trailer
+ */
+static int64_t split_GetGzipMemberSize( const unsigned char *trailer)
+{
+    return (int64_t)trailer[4] | ((int64_t)trailer[5] << 8)
+           | ((int64_t)trailer[6] << 16) | ((int64_t)trailer[7] << 24);
+}
+
+/**
+ * Decompress a BGZF block
+ */
+static void split_InflateBgzfBlock( const std::vector<unsigned char> &block,
+                                    std::vector<char> &data)
+{
+    int64_t extra_size = block[10] | (block[11] << 8);
+    int64_t deflate_start = 12 + extra_size;
+    int64_t deflate_size = block.size() - deflate_start - SPLIT_GZIP_TRAILER_SIZE;
+    z_stream stream = z_stream();
+
+    data.resize( split_GetGzipMemberSize( &block[block.size()
+                                                 - SPLIT_GZIP_TRAILER_SIZE]));
+
+    /* Raw deflate data: the header and the trailer are parsed here */
+    if ( (deflate_size < 0) || (inflateInit2( &stream, -MAX_WBITS) != Z_OK) )
+    {
+        SPLIT_ERROR( "Cannot decompress a BGZF block of the input file");
+    }
+
+    stream.next_in = (Bytef *)&block[deflate_start];
+    stream.avail_in = deflate_size;
+    /* An empty block (such as the end-of-file marker of BGZF) still needs
+       some room for output to be decompressed */
+    char scratch = 0;
+
+    stream.next_out = (Bytef *)(data.empty() ? &scratch : data.data());
+    stream.avail_out = data.empty() ? 1 : data.size();
+
+    int res = inflate( &stream, Z_FINISH);
+
+    inflateEnd( &stream);
+
+    if ( (res != Z_STREAM_END) || (stream.avail_out != (data.empty() ? 1u : 0u)) )
+    {
+        SPLIT_ERROR( "Corrupted BGZF block in the input file");
+    }
+}
+
+/**
+ * Thread decompressing BGZF blocks. Blocks are read from the input file under
+ * the lock, so they are queued in the order of the input. Decompression goes
+ * without the lock
+ */
+static void split_InflateBgzf( split_Inflater_t *inflater)
+{
+    std::vector<unsigned char> compressed;
+
+    while ( 1 )
+    {
+        split_InflatedBlock_t *block = NULL;
+
+        {
+            std::unique_lock<std::mutex> guard( inflater->lock);
+
+            while ( !inflater->is_input_end && !inflater->is_stopped
+                    && (inflater->blocks.size() >= inflater->max_blocks) )
+            {
+                inflater->cond.wait( guard);
+            }
+
+            if ( inflater->is_input_end || inflater->is_stopped )
+            {
+                return;
+            }
+
+            if ( !split_ReadBgzfBlock( inflater->fd, compressed) )
+            {
+                inflater->is_input_end = true;
+                inflater->cond.notify_all();
+
+                return;
+            }
+
+            block = new split_InflatedBlock_t();
+            block->is_done = false;
+            inflater->blocks.push_back( block);
+        }
+
+        split_InflateBgzfBlock( compressed, block->data);
+
+        std::lock_guard<std::mutex> guard( inflater->lock);
+
+        block->is_done = true;
+        inflater->cond.notify_all();
+    }
+}
+
+/**
+ * Thread decompressing plain gzip. Members of multi-member files are
+ * decompressed one after another
+ */
+static void split_InflateGzip( split_Inflater_t *inflater)
+{
+    std::vector<unsigned char> compressed( SPLIT_GZIP_BLOCK_SIZE);
+    z_stream stream = z_stream();
+    bool is_file_end = false;
+    int res = Z_OK;
+
+    /* Accept gzip header only */
+    if ( inflateInit2( &stream, MAX_WBITS + 16) != Z_OK )
+    {
+        SPLIT_ERROR( "Cannot initialize gzip decompression");
+    }
+
+    while ( !is_file_end || stream.avail_in || (res != Z_STREAM_END) )
+    {
+        split_InflatedBlock_t *block = new split_InflatedBlock_t();
+
+        block->is_done = false;
+        block->data.resize( SPLIT_GZIP_BLOCK_SIZE);
+
+        {
+            std::unique_lock<std::mutex> guard( inflater->lock);
+
+            while ( !inflater->is_stopped
+                    && (inflater->blocks.size() >= inflater->max_blocks) )
+            {
+                inflater->cond.wait( guard);
+            }
+
+            if ( inflater->is_stopped )
+            {
+                delete block;
+                inflateEnd( &stream);
+
+                return;
+            }
+
+            inflater->blocks.push_back( block);
+        }
+
+        stream.next_out = (Bytef *)block->data.data();
+        stream.avail_out = block->data.size();
+
+        while ( stream.avail_out )
+        {
+            if ( !stream.avail_in && !is_file_end )
+            {
+                int64_t bytes_read = read( inflater->fd, compressed.data(),
+                                           compressed.size());
+
+                if ( bytes_read == -1 )
+                {
+                    char err_msg[500];
+
+                    SPLIT_ERROR( "Cannot read data from the input file: %s",
+                                 SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+                }
+
+                is_file_end = !bytes_read;
+                stream.next_in = compressed.data();
+                stream.avail_in = bytes_read;
+            }
+
+            if ( (res == Z_STREAM_END) && stream.avail_in )
+            {
+                /* Next member of a multi-member file */
+                inflateReset( &stream);
+            } else if ( (res == Z_STREAM_END) && is_file_end )
+            {
+                break;
+            }
+
+            res = inflate( &stream, Z_NO_FLUSH);
+
+            if ( (res == Z_BUF_ERROR) && is_file_end && !stream.avail_in )
+            {
+                SPLIT_ERROR( "Compressed input file is truncated");
+            } else if ( (res != Z_OK) && (res != Z_STREAM_END) && (res != Z_BUF_ERROR) )
+            {
+                SPLIT_ERROR( "Corrupted gzip data in the input file");
+            }
+        }
+
+        std::lock_guard<std::mutex> guard( inflater->lock);
+
+        block->data.resize( block->data.size() - stream.avail_out);
+        block->is_done = true;
+        inflater->cond.notify_all();
+    }
+
+    inflateEnd( &stream);
+
+    std::lock_guard<std::mutex> guard( inflater->lock);
+
+    inflater->is_input_end = true;
+    inflater->cond.notify_all();
+}
+
+/**
+ * Start decompression of an input file. For BGZF "num_threads" threads
+ * decompress blocks in parallel
+ */
+static void split_StartInflater( split_Inflater_t *inflater,
+                                 int fd,
+                                 split_Compression_t compression,
+                                 int64_t num_threads)
+{
+    inflater->fd = fd;
+    inflater->compression = compression;
+    inflater->offset = 0;
+    inflater->is_input_end = false;
+    inflater->is_stopped = false;
+
+    if ( compression == SPLIT_COMPRESSION_BGZF )
+    {
+        inflater->max_blocks = num_threads * SPLIT_BGZF_BLOCKS_PER_THREAD;
+
+        for ( int64_t i = 0; i < num_threads; i++ )
+        {
+            inflater->threads.push_back( split_StartWorker( &inflater->lock,
+                                                            &inflater->cond,
+                                                            std::bind( split_InflateBgzf,
+                                                                       inflater)));
+        }
+    } else
+    {
+        inflater->max_blocks = SPLIT_GZIP_MAX_BLOCKS;
+        inflater->threads.push_back( split_StartWorker( &inflater->lock, &inflater->cond,
+                                                        std::bind( split_InflateGzip,
+                                                                   inflater)));
+    }
+}
+
+/**
+ * Read decompressed data. Return amount of data read. It's less than "size"
+ * only at the end of the input
+ */
+static int64_t split_ReadInflated( split_Inflater_t *inflater, char *buff, int64_t size)
+{
+    int64_t bytes_read = 0;
+
+    while ( bytes_read < size )
+    {
+        split_InflatedBlock_t *block = NULL;
+
+        {
+            std::unique_lock<std::mutex> guard( inflater->lock);
+
+            while ( !inflater->is_input_end && !split_workers->is_failed
+                    && (inflater->blocks.empty() || !inflater->blocks.front()->is_done) )
+            {
+                inflater->cond.wait( guard);
+            }
+
+            split_CheckWorkers();
+
+            if ( inflater->blocks.empty() )
+            {
+                break;
+            }
+
+            /* With several BGZF threads the first block may still be in
+               work after the end of input is reached */
+            while ( !inflater->blocks.front()->is_done && !split_workers->is_failed )
+            {
+                inflater->cond.wait( guard);
+            }
+
+            split_CheckWorkers();
+
+            block = inflater->blocks.front();
+        }
+
+        /* The block is not changed anymore. No need to hold the lock */
+        int64_t chunk = std::min( (int64_t)(block->data.size() - inflater->offset),
+                                  size - bytes_read);
+
+        memcpy( buff + bytes_read, block->data.data() + inflater->offset, chunk);
+        bytes_read += chunk;
+        inflater->offset += chunk;
+
+        if ( inflater->offset == block->data.size() )
+        {
+            std::lock_guard<std::mutex> guard( inflater->lock);
+
+            delete block;
+            inflater->blocks.pop_front();
+            inflater->offset = 0;
+            inflater->cond.notify_all();
+        }
+    }
+
+    return bytes_read;
+}
+
+/**
+ * Stop decompression and wait for decompressing threads to finish. It may be
+ * repeated
+ */
+static void split_StopInflater( split_Inflater_t *inflater)
+{
+    {
+        std::lock_guard<std::mutex> guard( inflater->lock);
+
+        inflater->is_stopped = true;
+        inflater->cond.notify_all();
+    }
+
+    for ( size_t i = 0; i < inflater->threads.size(); i++ )
+    {
+        inflater->threads[i].join();
+    }
+
+    for ( size_t i = 0; i < inflater->blocks.size(); i++ )
+    {
+        delete inflater->blocks[i];
+    }
+
+    inflater->threads.clear();
+    inflater->blocks.clear();
+}
+
+/**
+ * Get total size of decompressed data of an input file
+ *
+ * For BGZF only headers and trailers of blocks are read. Plain gzip has to be
+ * decompressed fully, because sizes in gzip trailers are modulo 4G and there
+ * may be several members. Splitting by piece size ("--piece-size") avoids
+ * this additional pass
+ */
+static int64_t split_GetInflatedSize( int fd, split_Compression_t compression)
+{
+    char err_msg[500];
+    int64_t size = 0;
+
+    if ( compression == SPLIT_COMPRESSION_BGZF )
+    {
+        unsigned char header[SPLIT_BGZF_HEADER_SIZE];
+        unsigned char trailer[SPLIT_GZIP_TRAILER_SIZE];
+        int64_t offset = 0;
+
+        while ( pread( fd, header, sizeof( header), offset) == sizeof( header) )
+        {
+            int64_t block_size = (header[16] | (header[17] << 8)) + 1;
+
+            if ( pread( fd, trailer, sizeof( trailer),
+                        offset + block_size - SPLIT_GZIP_TRAILER_SIZE)
+                 != sizeof( trailer) )
+            {
+                SPLIT_ERROR( "Compressed input file is truncated");
+            }
+
+            size += split_GetGzipMemberSize( trailer);
+            offset += block_size;
+        }
+    } else
+    {
+        split_Inflater_t inflater;
+        std::vector<char> buff( SPLIT_GZIP_BLOCK_SIZE);
+        int64_t bytes_read = 0;
+
+        split_OnError_t stop_inflater( [&]()
+        {
+            split_StopInflater( &inflater);
+        });
+
+        split_StartInflater( &inflater, fd, compression, 1);
+
+        while ( (bytes_read = split_ReadInflated( &inflater, buff.data(),
+                                                  buff.size())) )
+        {
+            size += bytes_read;
+        }
+
+        split_StopInflater( &inflater);
+
+        /* Return to the beginning of the file */
+        if ( lseek( fd, 0, SEEK_SET) == -1 )
+        {
+            SPLIT_ERROR( "Cannot seek input file: %s",
+                         SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+        }
+    }
+
+    return size;
+}
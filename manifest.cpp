@@ -0,0 +1,270 @@
+/**
+ * Copyright © 2016 Andrey Nevolin, https://github.com/AndreyNevolin
+ * Twitter: @Andrey_Nevolin
+ * LinkedIn: https://www.linkedin.com/in/andrey-nevolin-76387328
+ *
+ * Manifest of a split: byte ranges of the pieces inside the input file
+ *
+ * A manifest lets consumers read their pieces directly from the input file
+ * (for example with "pread()") instead of reading copies of the pieces. It's
+ * also kept between runs of incremental splitting of a growing input. The
+ * manifest is written in two forms with the same contents:
+ *   - text "<name>.manifest". Lines starting with '#' describe the input.
+ *     Then each line describes a piece with tab-separated fields: number of
+ *     the piece, offset, length and number of records
+ *   - binary "<name>.manifest.bin". All integers are 64-bit little-endian:
+ *       magic "SPLITMAN" (8 bytes), version, input size, size and CRC32 of
+ *       the tail of the input, number of pieces, length of the input path
+ *       followed by the path (not terminated), then number, offset, length
+ *       and number of records of each piece
+ *
+ * Number of records is "-1" if it's unknown (it can't be known without
+ * reading the data, unless records are of fixed size). The tail is the last
+ * bytes of the input split. When the input grows, a matching tail confirms
+ * that the input was appended to rather than rewritten. Only the binary form
+ * is read back by the tool
+ */
+
+/* Version of the binary manifest */
+#define SPLIT_MANIFEST_VERSION 1
+/* Maximum size of the tail of the input covered by the checksum */
+#define SPLIT_MANIFEST_TAIL_SIZE 65536
+
+/* Magic starting the binary manifest */
+static const char split_manifest_magic[] = {'S', 'P', 'L', 'I', 'T', 'M', 'A', 'N'};
+
+/**
+ * Piece described by a manifest
+ */
+typedef struct
+{
+    /* Offset of the first byte of the piece inside the input file */
+    int64_t offset;
+    /* Size of the piece in bytes */
+    int64_t size;
+    /* Number of records in the piece. "-1" if it's unknown */
+    int64_t num_records;
+} split_ManifestPiece_t;
+
+/**
+ * Manifest of a split
+ */
+typedef struct
+{
+    std::string input_path;
+    int64_t input_size;
+    /* Size and CRC32 of the tail of the input */
+    int64_t tail_size;
+    int64_t tail_crc;
+    std::vector<split_ManifestPiece_t> pieces;
+} split_Manifest_t;
+
+/**
+ * Append a 64-bit little-endian integer to binary data
+ */
+static void split_AppendInt64( std::vector<char> & data, int64_t value)
+{
+    for ( int i = 0; i < 8; i++ )
+    {
+        data.push_back( ((uint64_t)value >> (8 * i)) & 0xff);
+    }
+}
+
+/**
+ * Take a 64-bit little-endian integer from binary data. Return "false" if the
+ * data is exhausted
+ */
+static bool split_TakeInt64( const std::vector<char> & data, size_t *offset,
+                             int64_t *value)
+{
+    uint64_t result = 0;
+
+    if ( data.size() - *offset < 8 )
+    {
+        return false;
+    }
+
+    for ( int i = 0; i < 8; i++ )
+    {
+        result |= (uint64_t)(unsigned char)data[*offset + i] << (8 * i);
+    }
+
+    *offset += 8;
+    *value = result;
+
+    return true;
+}
+
+/**
+ * Write data to a file. An existing file is replaced atomically: data is
+ * written to a temporary file which is then renamed
+ */
+static void split_WriteWholeFile( const std::string & path, const char *data,
+                                  int64_t size)
+{
+    char err_msg[500];
+    std::string temp_path = path + ".tmp";
+    int fd = open( temp_path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+
+    if ( fd == -1 )
+    {
+        SPLIT_ERROR( "Cannot create file \"%s\": %s", temp_path.c_str(),
+                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+    }
+
+    for ( int64_t written = 0; written < size; )
+    {
+        int64_t res = write( fd, data + written, size - written);
+
+        if ( res == -1 )
+        {
+            if ( errno == EINTR )
+            {
+                continue;
+            }
+
+            SPLIT_ERROR( "Cannot write file \"%s\": %s", path.c_str(),
+                         SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+        }
+
+        written += res;
+    }
+
+    if ( fsync( fd) == -1 )
+    {
+        SPLIT_ERROR( "Cannot sync file \"%s\": %s", path.c_str(),
+                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+    }
+
+    close( fd);
+
+    if ( rename( temp_path.c_str(), path.c_str()) == -1 )
+    {
+        SPLIT_ERROR( "Cannot rename \"%s\" to \"%s\": %s", temp_path.c_str(),
+                     path.c_str(), SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+    }
+}
+
+/**
+ * Write text and binary forms of a manifest. "path" is the path of the text
+ * form. ".bin" is appended to it for the binary form
+ */
+static void split_WriteManifest( const std::string & path,
+                                 const split_Manifest_t *manifest)
+{
+    std::string text = "# split manifest\n";
+    std::vector<char> binary( split_manifest_magic,
+                              split_manifest_magic + sizeof( split_manifest_magic));
+    char line[200];
+    int64_t num_pieces = manifest->pieces.size();
+
+    text += "# input " + manifest->input_path + "\n";
+    snprintf( line, sizeof( line), "# size %ld\n# tail %ld %ld\n"
+              "# piece\toffset\tlength\trecords\n", manifest->input_size,
+              manifest->tail_size, manifest->tail_crc);
+    text += line;
+    split_AppendInt64( binary, SPLIT_MANIFEST_VERSION);
+    split_AppendInt64( binary, manifest->input_size);
+    split_AppendInt64( binary, manifest->tail_size);
+    split_AppendInt64( binary, manifest->tail_crc);
+    split_AppendInt64( binary, num_pieces);
+    split_AppendInt64( binary, manifest->input_path.size());
+    binary.insert( binary.end(), manifest->input_path.begin(),
+                   manifest->input_path.end());
+
+    for ( int64_t i = 0; i < num_pieces; i++ )
+    {
+        const split_ManifestPiece_t & piece = manifest->pieces[i];
+
+        snprintf( line, sizeof( line), "%ld\t%ld\t%ld\t%ld\n", i, piece.offset,
+                  piece.size, piece.num_records);
+        text += line;
+        split_AppendInt64( binary, i);
+        split_AppendInt64( binary, piece.offset);
+        split_AppendInt64( binary, piece.size);
+        split_AppendInt64( binary, piece.num_records);
+    }
+
+    split_WriteWholeFile( path, text.data(), text.size());
+    split_WriteWholeFile( path + ".bin", binary.data(), binary.size());
+}
+
+/**
+ * Read the binary form of a manifest. "path" is the path of the text form (as
+ * for "split_WriteManifest()"). Return "false" if there is no manifest
+ */
+static bool split_ReadManifest( const std::string & path, split_Manifest_t *manifest)
+{
+    char err_msg[500];
+    std::string bin_path = path + ".bin";
+    int fd = open( bin_path.c_str(), O_RDONLY);
+
+    if ( (fd == -1) && (errno == ENOENT) )
+    {
+        return false;
+    } else if ( fd == -1 )
+    {
+        SPLIT_ERROR( "Cannot open manifest \"%s\": %s", bin_path.c_str(),
+                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+    }
+
+    std::vector<char> data;
+    char buff[65536];
+    int64_t res = 0;
+
+    while ( (res = read( fd, buff, sizeof( buff))) )
+    {
+        if ( (res == -1) && (errno == EINTR) )
+        {
+            continue;
+        } else if ( res == -1 )
+        {
+            SPLIT_ERROR( "Cannot read manifest \"%s\": %s", bin_path.c_str(),
+                         SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+        }
+
+        data.insert( data.end(), buff, buff + res);
+    }
+
+    close( fd);
+
+    size_t offset = sizeof( split_manifest_magic);
+    int64_t version = 0, num_pieces = 0, path_size = 0;
+    bool is_ok = (data.size() >= offset)
+                 && !memcmp( data.data(), split_manifest_magic, offset)
+                 && split_TakeInt64( data, &offset, &version)
+                 && (version == SPLIT_MANIFEST_VERSION)
+                 && split_TakeInt64( data, &offset, &manifest->input_size)
+                 && split_TakeInt64( data, &offset, &manifest->tail_size)
+                 && split_TakeInt64( data, &offset, &manifest->tail_crc)
+                 && split_TakeInt64( data, &offset, &num_pieces)
+                 && split_TakeInt64( data, &offset, &path_size)
+                 && (path_size >= 0) && ((int64_t)(data.size() - offset) >= path_size);
+
+    if ( is_ok )
+    {
+        manifest->input_path.assign( &data[offset], path_size);
+        offset += path_size;
+        manifest->pieces.clear();
+    }
+
+    for ( int64_t i = 0; is_ok && (i < num_pieces); i++ )
+    {
+        int64_t piece_num = 0;
+        split_ManifestPiece_t piece;
+
+        is_ok = split_TakeInt64( data, &offset, &piece_num) && (piece_num == i)
+                && split_TakeInt64( data, &offset, &piece.offset)
+                && split_TakeInt64( data, &offset, &piece.size)
+                && split_TakeInt64( data, &offset, &piece.num_records);
+        manifest->pieces.push_back( piece);
+    }
+
+    if ( !is_ok || (offset != data.size()) )
+    {
+        SPLIT_ERROR( "Manifest \"%s\" is corrupted or of unsupported version",
+                     bin_path.c_str());
+    }
+
+    return true;
+}
@@ -0,0 +1,216 @@
+/**
+ * Copyright © 2016 Andrey Nevolin, https://github.com/AndreyNevolin
+ * Twitter: @Andrey_Nevolin
+ * LinkedIn: https://www.linkedin.com/in/andrey-nevolin-76387328
+ *
+ * Consumers of pieces (see "splitter.h")
+ *
+ * If a sink is set for a split, routines writing output files pass pieces to
+ * the sink instead. The number of a piece serves as its "descriptor", so the
+ * splitting loops are the same for files and sinks. Data is passed right from
+ * the double-buffer. Pieces passed to a sink are not preallocated and not
+ * synced
+ */
+
+/**
+ * Sink of a split
+ */
+typedef struct
+{
+    /* Consumer of pieces. NULL if pieces are written to files */
+    split::Sink *sink;
+    /* Amount of data written to unfinished pieces */
+    std::map<int64_t, int64_t> sizes;
+} split_SinkState_t;
+
+static thread_local split_SinkState_t *split_sink_state = NULL;
+
+/**
+ * Start a piece passed to the sink. Return "descriptor" of the piece
+ */
+static int split_StartSinkPiece( const std::string & name, int64_t piece_num)
+{
+    SPLIT_ASSERT( piece_num <= INT_MAX);
+    split_sink_state->sink->StartPiece( piece_num, name);
+    split_sink_state->sizes[piece_num] = 0;
+
+    return piece_num;
+}
+
+/**
+ * Pass data of a piece to the sink
+ */
+static void split_WriteSink( int piece_num, const char *data, int64_t size)
+{
+    int64_t start = split_StartTimer();
+
+    split_sink_state->sink->Write( piece_num, data, size);
+    split_StopTimer( SPLIT_PHASE_WRITE, start, size);
+    split_sink_state->sizes[piece_num] += size;
+}
+
+/**
+ * Finish a piece passed to the sink. Return size of the piece
+ */
+static int64_t split_FinishSinkPiece( int piece_num)
+{
+    int64_t piece_size = split_sink_state->sizes[piece_num];
+
+    split_sink_state->sink->FinishPiece( piece_num, piece_size);
+    split_sink_state->sizes.erase( piece_num);
+
+    return piece_size;
+}
+
+namespace split
+{
+
+FileSink::FileSink( const std::string & dir, const std::string & name)
+    : dir( dir), name( name)
+{
+}
+
+const std::string & FileSink::GetDir() const
+{
+    return dir;
+}
+
+const std::string & FileSink::GetName() const
+{
+    return name;
+}
+
+void FileSink::StartPiece( int64_t piece_num, const std::string & name)
+{
+    std::string path = dir + "/" + name;
+    char err_msg[500];
+    int fd = open( path.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0644);
+
+    if ( fd == -1 )
+    {
+        SPLIT_ERROR( "Cannot create output file \"%s\": %s", path.c_str(),
+                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+    }
+
+    fds[piece_num] = fd;
+}
+
+void FileSink::Write( int64_t piece_num, const char *data, int64_t size)
+{
+    char err_msg[500];
+    int fd = fds[piece_num];
+
+    while ( size )
+    {
+        int64_t res = write( fd, data, size);
+
+        if ( res == -1 )
+        {
+            if ( errno == EINTR )
+            {
+                continue;
+            }
+
+            SPLIT_ERROR( "Cannot write data to output file: %s",
+                         SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+        }
+
+        data += res;
+        size -= res;
+    }
+}
+
+void FileSink::FinishPiece( int64_t piece_num, int64_t size)
+{
+    close( fds[piece_num]);
+    fds.erase( piece_num);
+}
+
+MemorySink::MemorySink( PieceHandler on_piece) : on_piece( on_piece)
+{
+}
+
+std::vector<int64_t> MemorySink::GetPieceNums() const
+{
+    std::vector<int64_t> piece_nums;
+
+    for ( auto it = finished.begin(); it != finished.end(); it++ )
+    {
+        piece_nums.push_back( it->first);
+    }
+
+    return piece_nums;
+}
+
+std::vector<char> MemorySink::TakePiece( int64_t piece_num)
+{
+    auto it = finished.find( piece_num);
+
+    if ( it == finished.end() )
+    {
+        SPLIT_ERROR( "Piece %ld is not in the sink", piece_num);
+    }
+
+    std::vector<char> data( std::move( it->second));
+
+    finished.erase( it);
+
+    return data;
+}
+
+void MemorySink::StartPiece( int64_t piece_num, const std::string & name)
+{
+    pieces[piece_num].clear();
+}
+
+void MemorySink::Write( int64_t piece_num, const char *data, int64_t size)
+{
+    std::vector<char> & piece = pieces[piece_num];
+
+    piece.insert( piece.end(), data, data + size);
+}
+
+void MemorySink::FinishPiece( int64_t piece_num, int64_t size)
+{
+    std::vector<char> data( std::move( pieces[piece_num]));
+
+    pieces.erase( piece_num);
+
+    if ( on_piece )
+    {
+        on_piece( piece_num, std::move( data));
+    } else
+    {
+        finished[piece_num] = std::move( data);
+    }
+}
+
+CallbackSink::CallbackSink( DataHandler on_data,
+                            StartHandler on_start,
+                            FinishHandler on_finish)
+    : on_data( on_data), on_start( on_start), on_finish( on_finish)
+{
+}
+
+void CallbackSink::StartPiece( int64_t piece_num, const std::string & name)
+{
+    if ( on_start )
+    {
+        on_start( piece_num, name);
+    }
+}
+
+void CallbackSink::Write( int64_t piece_num, const char *data, int64_t size)
+{
+    on_data( piece_num, data, size);
+}
+
+void CallbackSink::FinishPiece( int64_t piece_num, int64_t size)
+{
+    if ( on_finish )
+    {
+        on_finish( piece_num, size);
+    }
+}
+
+} /* namespace split */
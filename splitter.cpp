@@ -0,0 +1,5424 @@
+/**
+ * Copyright © 2016 Andrey Nevolin, https://github.com/AndreyNevolin
+ * Twitter: @Andrey_Nevolin
+ * LinkedIn: https://www.linkedin.com/in/andrey-nevolin-76387328
+ *
+ * Library that splits a file of "elements" into pieces of roughly equivalent sizes
+ * (see "splitter.h"). The tool is a thin layer on top of it (see "split.cpp").
+ * Each piece would contain an integer number of "elements" (i.e. one single element
+ * couldn't be divided between pieces. Each element is required to belong to some
+ * piece as a whole).
+ *
+ * Exact definition of "elements" is given by the file format selected with the
+ * "--format" option. The core of the tool is agnostic of the format. Each format
+ * provides a bound finder, and all of them are registered in "formats.cpp". The
+ * reference bound finder is the one for FASTA format (bioinformatics format for
+ * representing nucleotide or peptide sequences) defined in "find_bound_fasta.cpp".
+ * To support a different format, one needs to implement a bound finder for it and
+ * register it.
+ *
+ * The tool reads data from input file and writes data to output files in aligned
+ * chunks of fixed size (except maybe the last chunk read from/appended to a file).
+ * The size of a chunk can be specified by a user. By default it's 4Mb.
+ *
+ * To ensure that output files contain an integer number of "elements" each, the tool
+ * somehow needs to recognize bounds of individual elements. When last chunk of data
+ * is added to an output file, projected bound of a file might be shifted up or down
+ * to make the file include integer number of elements. That's where a bound finder
+ * comes to play. Given a buffer with data and projected output file bound, it should
+ * be able to find an element bound which is close to the projected bound.
+ *
+ * The tool works best when the chunk size is much bigger than the size of any
+ * "element". For more information about bound finders see comments inside
+ * "find_bound_fasta.cpp"
+ *
+ * Input files compressed with gzip or BGZF are recognized automatically and
+ * decompressed on the fly (see "inflate.cpp"). Pieces are then balanced by the
+ * size of decompressed data. Pieces may be compressed on the fly as well (see
+ * "deflate.cpp")
+ *
+ * Records may also be dealt to output files one by one instead of being cut
+ * into contiguous pieces (see "distribute.cpp")
+ *
+ * Phases of a split may be timed, and progress may be printed as data is
+ * transferred (see "stats.cpp"). Output files are synced to persistent store
+ * as selected by "--sync" (see "sync.cpp")
+ *
+ * Errors are thrown as exceptions. Errors of worker threads are passed to the
+ * thread running the split (see "split_StartWorker()"), and resources of a
+ * failed split are released (see "split_OnError_t"). Pieces may be passed to
+ * a consumer in memory instead of being written to files (see "sink.cpp").
+ * Each split keeps its state apart from others (see "split_context"), so
+ * splits may run concurrently
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <limits.h>
+#include <ctype.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#ifdef SPLIT_DEBUG
+#include <execinfo.h>
+#endif
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <typeinfo>
+#include "splitter.h"
+
+/* Default buffer size is 4Mb. It's used when the chunk size can't be derived
+   from the input file */
+#define SPLIT_BUFFER_SIZE_DEFAULT 4194304
+/* Default chunk size in preferred I/O blocks of the input file, and limits of
+   the derived chunk size */
+#define SPLIT_BLOCKS_PER_CHUNK 1024
+#define SPLIT_BUFFER_SIZE_MIN 65536
+#define SPLIT_BUFFER_SIZE_MAX (16 * 1024 * 1024)
+/* Default limit of memory taken by buffers grown to fit big elements */
+#define SPLIT_MAX_MEMORY_DEFAULT (1024LL * 1024 * 1024)
+/* Default number of double-buffers in the ring used by the pipeline engine */
+#define SPLIT_RING_DEPTH_DEFAULT 4
+/* Alignment assumed for direct I/O if the kernel can't report the real one.
+   It works for devices with both 512-byte and 4K logical blocks */
+#define SPLIT_DIRECT_IO_ALIGN_DEFAULT 4096
+/* Space preallocated for a piece beyond its projected size. Bounds of pieces
+   are shifted to element bounds, so pieces may grow a little */
+#define SPLIT_PREALLOC_SLACK (1024 * 1024)
+
+/**
+ * Engines used to move data from the input file to output files
+ */
+typedef enum
+{
+    /* Data is read to the double-buffer and written from it */
+    SPLIT_ENGINE_RW,
+    /* The same as "SPLIT_ENGINE_RW" but a separate thread reads data ahead to
+       a ring of double-buffers, so reading overlaps with writing */
+    SPLIT_ENGINE_PIPELINE,
+    /* Bounds of pieces are planned first. Then data is written to output files
+       directly from the memory-mapped input file */
+    SPLIT_ENGINE_MMAP,
+    /* Bounds of pieces are planned first. Then data is moved inside the
+       kernel by "copy_file_range()" or "splice()" */
+    SPLIT_ENGINE_COPY,
+    /* Bounds of pieces are planned first. Then the pieces are copied by
+       asynchronous requests submitted to io_uring */
+    SPLIT_ENGINE_URING
+} split_Engine_t;
+
+#ifdef SPLIT_DEBUG
+/**
+ * Print stack dump
+ */
+static inline void split_PrintStack()
+{
+    void *frames[100];
+    size_t stack_depth;
+    char **calls; 
+
+    fprintf( stderr, "Stack trace: \n");
+    stack_depth = backtrace( frames, 100);
+    calls = backtrace_symbols( frames, stack_depth);
+
+    for ( size_t i = 0; i < stack_depth; i++ )
+    {
+        printf ("\t[%2lu] %s\n", stack_depth - i - 1, calls[i]);
+    }
+
+    free( calls); 
+}
+
+#define SPLIT_ABORT \
+            fprintf( stderr, "\n"), \
+            fprintf( stderr, "Internal error: file \"%s\", line %u\n", __FILE__, __LINE__), \
+            fprintf( stderr, "\n"), \
+            fflush( NULL), \
+            split_PrintStack(), \
+            abort()
+#endif /* SPLIT_DEBUG */
+
+#ifdef SPLIT_DEBUG
+#    define SPLIT_ASSERT( condition_) ((condition_) || ( SPLIT_ABORT, 0))
+#else
+#    define SPLIT_ASSERT( condition_)
+#endif
+
+#define SPLIT_OUT( format_, ...) \
+            split_Log( format_, ##__VA_ARGS__)
+
+#define SPLIT_ERROR( format_, ...) \
+            split_Fail( format_, ##__VA_ARGS__)
+
+/**
+ * Wrapper around "strerror_r()" aimed at making calls to
+ * "strerror_r()" more compact and manageable
+ */
+static inline char *SPLIT_STRERROR_R( char *buff, size_t size)
+{
+    SPLIT_ASSERT( buff);
+
+    return strerror_r( errno, buff, size);
+}
+
+/**
+ * Fail with an error. The error is thrown to the caller of the library (see
+ * "splitter.h")
+ */
+static void split_Fail( const char *format, ...)
+    __attribute__ (( noreturn, format( printf, 1, 2)));
+
+static void split_Fail( const char *format, ...)
+{
+    va_list args;
+    char buff[1000];
+
+    va_start( args, format);
+    vsnprintf( buff, sizeof( buff), format, args);
+    va_end( args);
+
+    throw split::Error( buff);
+}
+
+/**
+ * State of a split
+ *
+ * Each split has its own state, so splits may run concurrently (and a sink or
+ * a receiver of messages may start another split). State of each component
+ * is reached through a thread-local pointer, which is bound to the state of
+ * the split run by the thread. Worker threads are bound to the state of the
+ * split that started them (see "split_StartWorker()"). The whole state is
+ * gathered in "split_Context_t" (see "split_BindContext()")
+ */
+struct split_Context_t;
+
+/* State of the split run by the current thread. NULL outside of splits */
+static thread_local split_Context_t *split_context = NULL;
+
+static void split_BindContext( split_Context_t *context);
+
+/**
+ * Messages of a split
+ */
+typedef struct
+{
+    /* Receiver of messages (sizes of written pieces, warnings). Messages are
+       dropped if it's not set */
+    split::Splitter::LogHandler handler;
+    /* Messages may come from worker threads. They are passed one at a time */
+    std::mutex lock;
+    /* Whether the far search warning was printed (see
+       "find_bound_lines.cpp"). It's printed once per split */
+    std::atomic<bool> is_far_scan_reported;
+} split_Messages_t;
+
+static thread_local split_Messages_t *split_messages = NULL;
+
+/**
+ * Pass a message to the receiver of messages of the current split (see
+ * "splitter.h")
+ */
+static void split_Log( const char *format, ...)
+    __attribute__ (( format( printf, 1, 2)));
+
+static void split_Log( const char *format, ...)
+{
+    if ( !split_messages || !split_messages->handler )
+    {
+        return;
+    }
+
+    va_list args;
+    char buff[1000];
+
+    va_start( args, format);
+    vsnprintf( buff, sizeof( buff), format, args);
+    va_end( args);
+
+    std::lock_guard<std::mutex> guard( split_messages->lock);
+
+    split_messages->handler( buff);
+}
+
+/**
+ * Worker threads of a split
+ */
+typedef struct
+{
+    /* The first error of a worker thread, and the indicator that some worker
+       thread failed */
+    std::exception_ptr error;
+    std::atomic<bool> is_failed;
+    std::mutex lock;
+} split_Workers_t;
+
+static thread_local split_Workers_t *split_workers = NULL;
+
+/**
+ * Start a worker thread running "body"
+ *
+ * An error can't be thrown out of a thread. So the first error of worker
+ * threads is kept, and threads waiting on "cond" (protected by "lock") are
+ * woken up. Waiting routines check "split_workers->is_failed" and rethrow the
+ * error (see "split_CheckWorkers()"), so it reaches the thread running the
+ * split. "lock" may be NULL if the thread is only joined. The thread is bound
+ * to the state of the current split
+ */
+static std::thread split_StartWorker( std::mutex *lock,
+                                      std::condition_variable *cond,
+                                      std::function<void()> body)
+{
+    split_Context_t *context = split_context;
+
+    return std::thread( [=]()
+    {
+        split_BindContext( context);
+
+        try
+        {
+            body();
+        } catch ( ... )
+        {
+            {
+                std::lock_guard<std::mutex> guard( split_workers->lock);
+
+                if ( !split_workers->error )
+                {
+                    split_workers->error = std::current_exception();
+                }
+            }
+
+            split_workers->is_failed = true;
+
+            if ( lock )
+            {
+                std::lock_guard<std::mutex> guard( *lock);
+
+                cond->notify_all();
+            }
+        }
+    });
+}
+
+/**
+ * Rethrow the error of a failed worker thread, if any
+ */
+static void split_CheckWorkers()
+{
+    if ( split_workers->is_failed )
+    {
+        std::lock_guard<std::mutex> guard( split_workers->lock);
+
+        std::rethrow_exception( split_workers->error);
+    }
+}
+
+/**
+ * Action run if the scope is left because of an error. It releases resources
+ * of a failed split (threads, descriptors, buffers). Actions should not fail
+ */
+class split_OnError_t
+{
+public:
+    split_OnError_t( std::function<void()> action) : action( action) {}
+
+    ~split_OnError_t()
+    {
+        if ( std::uncaught_exception() )
+        {
+            action();
+        }
+    }
+
+private:
+    std::function<void()> action;
+};
+
+/* Value that should be returned by a bound finder if element bound wasn't
+   found */
+#define SPLIT_BOUND_NOT_FOUND -12345
+#include "byte_search.cpp"
+#include "find_bound_fasta.cpp"
+#include "find_bound_lines.cpp"
+#include "find_bound_fastq.cpp"
+#include "weigh.cpp"
+#include "formats.cpp"
+#include "inflate.cpp"
+#include "concat.cpp"
+#include "deflate.cpp"
+#include "distribute.cpp"
+#include "manifest.cpp"
+#include "stats.cpp"
+#include "sync.cpp"
+#include "sink.cpp"
+
+/**
+ * Layouts of the double-buffer
+ */
+typedef enum
+{
+    /* The double-buffer is a ring mapped twice back-to-back in virtual memory.
+       Data remaining after a write is kept in place and the buffer itself is
+       shifted */
+    SPLIT_BUFFER_MIRROR,
+    /* The double-buffer is a plain memory area. Data remaining after a write
+       is copied from the upper half to the lower half */
+    SPLIT_BUFFER_HALVES
+} split_BufferLayout_t;
+
+/**
+ * Measures of piece sizes balanced between pieces
+ */
+typedef enum
+{
+    /* Size of data taken from the input (after decompression) */
+    SPLIT_BALANCE_BYTES,
+    /* Size of compressed output files */
+    SPLIT_BALANCE_COMPRESSED,
+    /* Number of records */
+    SPLIT_BALANCE_RECORDS,
+    /* Number of residues (bytes of records excluding headers and newlines) */
+    SPLIT_BALANCE_RESIDUES
+} split_Balance_t;
+
+/**
+ * Structure to keep command-line and derived options
+ */
+typedef struct
+{
+    /* Path to input file. If there are several input files, it's the first one */
+    std::string input_path;
+    /* Paths to all input files. Several files are split as a single input
+       (see "concat.cpp") */
+    std::vector<std::string> input_paths;
+    /* Format of the input file */
+    const split_Format_t *format;
+    /* Compression of the input file. It's detected by the file contents */
+    split_Compression_t compression;
+    /* Name of output directory */
+    std::string output_dir;
+    /* Base name of output files */
+    std::string output_file;
+    /* Number of output files */
+    int64_t num_pieces;
+    /* Projected size of output files. If it's not "0", the input is read as a
+       stream and a new piece is started each time this amount of data is
+       written (the number of pieces is not known in advance) */
+    int64_t piece_size;
+    /* Size in bytes of a buffer used to read/write files. Data
+       will be read/written mostly in chunks of this size. If an element
+       doesn't fit into a chunk, the chunk grows for a while */
+    int64_t buffer_size;
+    /* Limit of memory taken by double-buffers when chunks grow */
+    int64_t max_memory;
+    /* Number of threads copying pieces. When it's bigger than "1", bounds of
+       all pieces are planned first and the pieces are copied in parallel */
+    int64_t num_threads;
+    /* Engine used to move data */
+    split_Engine_t engine;
+    /* Number of double-buffers in the ring used by the pipeline engine */
+    int64_t ring_depth;
+    /* Indicator that input and output files are accessed with direct I/O
+       (i.e. bypassing the page cache) */
+    bool is_direct;
+    /* Layout of the double-buffer */
+    split_BufferLayout_t buffer_layout;
+    /* Size of fixed-size records. If it's not "0", bounds of pieces are
+       calculated arithmetically instead of being searched in the data */
+    int64_t record_size;
+    /* Size of the header preceding the records. The header goes to the first
+       piece */
+    int64_t header_size;
+    /* Compression of output files */
+    split_Compression_t output_compression;
+    /* Compression level (zlib levels from 0 to 9) */
+    int compression_level;
+    /* Extension appended to names of output files */
+    std::string output_extension;
+    /* Measure of piece sizes balanced between pieces */
+    split_Balance_t balance;
+    /* Amount of data sampled to estimate total weight of the input when
+       pieces are balanced by records or residues. If it's "0", the whole
+       input is weighed */
+    int64_t balance_sample;
+    /* Number of records in each piece. If it's not "0", the input is read as
+       a stream (as with "piece_size") */
+    int64_t records_per_piece;
+    /* Way of dealing records to output files. If it's not
+       "SPLIT_DISTRIBUTE_NONE", records are dealt to "num_pieces" files instead
+       of being cut into contiguous pieces */
+    split_Distribution_t distribution;
+    /* Indicator that only bounds of pieces are found and written to a manifest
+       (see "manifest.cpp"). No data is copied */
+    bool is_plan_only;
+    /* Indicator that a growing input is split incrementally: only data
+       appended since the previous split is split (see "manifest.cpp") */
+    bool is_incremental;
+    /* Offset of the input file to start splitting from, and number of the
+       first piece written. Both are derived from the manifest of the previous
+       split in incremental mode */
+    int64_t start_offset;
+    int64_t first_piece;
+    /* Indicator that statistics of the split are printed in JSON (see
+       "stats.cpp") */
+    bool is_stats;
+    /* Indicator that a progress line is printed while splitting */
+    bool is_progress;
+    /* Mode of syncing output files to persistent store */
+    split_Sync_t sync_mode;
+} split_Opts_t;
+
+/**
+ * Piece of the input file planned to become a separate output file
+ */
+typedef struct
+{
+    /* Offset of the first byte of the piece inside the input file */
+    int64_t offset;
+    /* Size of the piece in bytes */
+    int64_t size;
+} split_Piece_t;
+
+/**
+ * Description of command line options used by "getopt_long()"
+ */
+static struct option split_long_options_desc[] =
+{
+    /* Output directory */
+    {"od", required_argument, 0, 'd'},
+    /* Base of output file name */
+    {"of", required_argument, 0, 'f'},
+    /* Chunk size */
+    {"cs", required_argument, 0, 'c'},
+    /* Size of pieces of an input stream */
+    {"piece-size", required_argument, 0, 'p'},
+    /* Data moving engine */
+    {"engine", required_argument, 0, 'e'},
+    /* Shortcut for the memory-mapping engine */
+    {"mmap", no_argument, 0, 'm'},
+    /* Depth of the ring of buffers used by the pipeline engine */
+    {"ring-depth", required_argument, 0, 'r'},
+    /* Direct I/O */
+    {"direct", no_argument, 0, 'D'},
+    /* Layout of the double-buffer */
+    {"buffer", required_argument, 0, 'b'},
+    /* Format of the input file */
+    {"format", required_argument, 0, 'F'},
+    /* Size of fixed-size records */
+    {"record-size", required_argument, 0, 'R'},
+    /* Size of the header preceding fixed-size records */
+    {"header-size", required_argument, 0, 'H'},
+    /* Compression of output files */
+    {"compress", required_argument, 0, 'z'},
+    /* Compression level */
+    {"compress-level", required_argument, 0, 'L'},
+    /* Measure of piece sizes balanced between pieces */
+    {"balance", required_argument, 0, 'B'},
+    /* Amount of data sampled to estimate weight of the input */
+    {"balance-sample", required_argument, 0, 'S'},
+    /* Number of records in each piece */
+    {"records-per-piece", required_argument, 0, 'N'},
+    /* Way of dealing records to output files */
+    {"distribute", required_argument, 0, 'T'},
+    /* Write a manifest of pieces instead of copying them */
+    {"plan-only", no_argument, 0, 'P'},
+    /* Split only data appended since the previous split */
+    {"incremental", no_argument, 0, 'I'},
+    /* Format of statistics of the split */
+    {"stats", required_argument, 0, 's'},
+    /* Print progress of the split */
+    {"progress", no_argument, 0, 'g'},
+    /* Mode of syncing output files */
+    {"sync", required_argument, 0, 'y'},
+    /* Limit of memory of grown buffers */
+    {"max-memory", required_argument, 0, 'M'},
+    {0,    0,                 0, 0}
+};
+
+/**
+ * Description of short options
+ * 
+ * '+' means that parsing stops when first non-option argument is encountered
+ * ':' in the beginning means that ':' will be returned by 'getopt()' for missing
+ *     option arguments
+ * ':' after option character means that this particular option requires an
+ *     argument
+ * 'n' - number of output files
+ * 'j' - number of threads copying pieces
+ */
+std::string split_short_options_desc = "+:n:j:";
+
+/**
+ * Fail on an error in the options. The message is completed with an
+ * assistance note by the tool (see "split.cpp")
+ */
+void split_FailWithAssist( const char *buff)
+{
+    throw split::Error( buff, true);
+}
+
+static const char *usage_format[] =
+{
+    "Usage: %s {-n <number of pieces> | --piece-size <size> | "
+    "--records-per-piece <number>} [-j <number of threads>] "
+    "[-od <output directory>] "
+    "[-of <basis for output file name>] [-cs <chunk size>] "
+    "[--max-memory <size>] [--format <format>] "
+    "[--engine <engine>] "
+    "[--mmap] [--ring-depth <depth>] [--direct] [--buffer <layout>] "
+    "[--record-size <bytes> [--header-size <bytes>]] "
+    "[--compress <compression> [--compress-level <level>]] "
+    "[--balance <measure> [--balance-sample <size>]] "
+    "[--distribute <mode>] [--plan-only] [--incremental] "
+    "[--stats <format>] [--progress] [--sync <mode>] "
+    "<path to file to split> [<path to file to split>...]",
+    ""
+};
+
+static const char *usage_options[] =
+{
+    " ",
+    "Split file into pieces of roughly equivalent sizes. Each piece will contain an "
+    "integer number of records from the input file",
+    " ",
+    "OPTIONS:",
+    "   -n          Number of pieces to produce. Each piece will be placed into",
+    "               a separate file named \"<file name>.<number>\", where \"<file",
+    "               name>\" is a name provided through \"--of\" option or the",
+    "               name of the input file (if \"--of\" option is not used).",
+    "               \"<number>\" is a sequential number of a piece",
+    "       --piece-size",
+    "               Split the input as a stream: start a new piece each time this",
+    "               amount of data is written to the current one (the piece is",
+    "               then cut at the nearest record bound). Each piece is",
+    "               finalized as soon as it's complete. The input may be a pipe,",
+    "               and \"-\" stands for the standard input. Pieces are numbered",
+    "               without leading zeros, because their number is not known in",
+    "               advance. Units may be used as for \"--cs\". This option",
+    "               can't be used together with \"-n\", and is supported only by",
+    "               the \"rw\" engine running in a single thread without direct",
+    "               I/O",
+    "       --records-per-piece",
+    "               Split the input as a stream (as \"--piece-size\" does),",
+    "               putting this number of records to each piece. The last",
+    "               piece may have fewer records. Records are counted by the",
+    "               layout of the format: a header line for FASTA, four lines",
+    "               for FASTQ, a line for other formats (so for CSV a quoted",
+    "               field with newlines makes a piece shorter by a record, but",
+    "               a record is never divided between pieces)",
+    "   -j          Number of threads copying pieces. If it's bigger than 1,",
+    "               bounds of all pieces are found first by reading only small",
+    "               windows of the input file around projected bounds. Then the",
+    "               pieces are copied in parallel using positioned I/O. Output",
+    "               is identical to the one produced by a single thread. For a",
+    "               BGZF input file it's the number of threads decompressing",
+    "               blocks of the input. For compressed output it's the number",
+    "               of threads compressing blocks of pieces. With",
+    "               \"--distribute\" it's the number of threads dealing records.",
+    "               The default value for this option is 1",
+    "       --od    Path to output directory. By default current directory will",
+    "               be used for output",
+    "       --of    Basis for output file names. Output files will be named",
+    "               \"<file name>.<number>\", where \"<file name>\" is a string",
+    "               provided through this option or the name of the input file",
+    "               (if this option is not used)",
+    "       --cs    Data chunk size. Data will be read from input file and written",
+    "               to output files by chunks of this size (except maybe the last",
+    "               chunk read from/written to file). The size may be provided in",
+    "               different units: 512B, 4K, 8M, 1G (\"B\" for bytes, \"K\" for",
+    "               kilobytes, \"M\" for megabytes, and \"G\" for gigabytes). If",
+    "               units identifier is omitted, byte units are implied. By",
+    "               default the chunk is 1024 preferred I/O blocks of the input",
+    "               file (rounded up to a multiple of the maximum request size",
+    "               of the underlying block device) but at least 64K and at",
+    "               most 16M. It's 4M if the input can't be examined. If an",
+    "               element doesn't fit into a chunk, the chunk is doubled",
+    "               until the element fits, and the original size is restored",
+    "               after the element is written. Growth is supported by the",
+    "               \"rw\" engine (including planning with \"-j\" and the",
+    "               \"mmap\", \"copy\" and \"uring\" engines) and by",
+    "               distribution of records, but not by the \"pipeline\"",
+    "               engine",
+    "       --max-memory",
+    "               Limit of memory taken by double-buffers when chunks grow.",
+    "               A double-buffer is twice the chunk size. Distribution of",
+    "               records keeps two double-buffers per thread plus one. Units",
+    "               may be used as for \"--cs\". The default is 1G",
+    "       --format",
+    "               Format of the input file:",
+    "                 fasta",
+    "                      - FASTA with each sequence on a single line (default)",
+    "                 fasta-multiline",
+    "                      - FASTA with sequences split into several lines",
+    "                 fastq",
+    "                      - FASTQ with records of four lines",
+    "                 lines",
+    "                      - each line is a record (NDJSON, TSV, plain text)",
+    "                 csv  - each line is a record, except for newlines inside",
+    "                        quoted fields",
+    "       --engine",
+    "               Engine used to move data from the input file to output files:",
+    "                 rw   - data is read to an internal buffer and written from",
+    "                        it (default)",
+    "                 pipeline",
+    "                      - the same as \"rw\", but a separate thread reads data",
+    "                        ahead to a ring of buffers, so reading of the input",
+    "                        file overlaps with writing of output files",
+    "                 mmap - bounds of pieces are found first. Then the input",
+    "                        file is memory-mapped and the pieces are written",
+    "                        directly from the mapping. Pages behind the copying",
+    "                        cursor are released, so memory consumption stays",
+    "                        bounded for inputs bigger than RAM",
+    "                 copy - bounds of pieces are found first by reading small",
+    "                        windows of the input file. Then the pieces are copied",
+    "                        inside the kernel with \"copy_file_range()\" or",
+    "                        \"splice()\" (may be a server-side copy on network",
+    "                        file systems). If neither is supported, data is read",
+    "                        and written through an internal buffer",
+    "                 uring",
+    "                      - bounds of pieces are found first. Then a single",
+    "                        thread copies the pieces by asynchronous requests",
+    "                        submitted to io_uring with several chunks in flight.",
+    "                        Pieces are synced asynchronously too. If io_uring is",
+    "                        not available, the \"rw\" way of copying is used",
+    "       --mmap  Same as \"--engine mmap\"",
+    "       --ring-depth",
+    "               Number of buffers in the ring used by the pipeline engine.",
+    "               Each buffer is of double chunk size. For the uring engine",
+    "               it's the number of chunks in flight. The minimum value is 2.",
+    "               The default value for this option is 4",
+    "       --direct",
+    "               Read the input file and write output files with direct I/O,",
+    "               bypassing the page cache. Chunk size must be a multiple of",
+    "               logical block size of the devices. Unaligned end of each",
+    "               output file is written padded to a whole block, and then",
+    "               the file is truncated to its real size. Supported only by",
+    "               the \"rw\" engine running in a single thread",
+    "       --buffer",
+    "               Layout of the internal buffer used by the \"rw\" engine:",
+    "                 mirror - the buffer is a ring mapped twice back-to-back in",
+    "                          virtual memory, so data always looks contiguous",
+    "                          and is never moved inside the buffer (default)",
+    "                 halves - the buffer consists of two halves. Data remaining",
+    "                          in the upper half after a write is copied to the",
+    "                          lower half",
+    "               If a mirrored ring can't be created, two halves are used",
+    "       --record-size",
+    "               Size in bytes of records of the input file. Use it for files",
+    "               of fixed-size records (binary structures, fixed-length",
+    "               reads). Bounds of pieces are then calculated arithmetically",
+    "               without looking at the data: each bound is rounded to the",
+    "               nearest end of a record. Combined with \"--engine copy\" the",
+    "               input file is split without reading any data to user space.",
+    "               Record size plus header size should not exceed chunk size",
+    "       --header-size",
+    "               Size in bytes of a header preceding the records. The header",
+    "               is placed to the first piece as a whole, and records are",
+    "               counted from its end. The default value for this option is 0",
+    "       --compress",
+    "               Compress output files:",
+    "                 gzip - a single gzip member per piece",
+    "                 bgzf - blocked gzip (as produced by \"bgzip\"). Pieces",
+    "                        can be indexed and read at random offsets",
+    "               Output files are named \"<file name>.<number>.gz\". Blocks",
+    "               of each piece are compressed in parallel by \"-j\" threads.",
+    "               Supported by the \"rw\" and \"pipeline\" engines without",
+    "               direct I/O",
+    "       --compress-level",
+    "               Compression level from 0 (no compression) to 9 (best",
+    "               compression). The default value for this option is 6",
+    "       --balance",
+    "               Measure of piece sizes balanced between pieces:",
+    "                 bytes - size of data taken from the input file (after",
+    "                         decompression of a compressed input) (default)",
+    "                 records",
+    "                       - number of records (counted as for",
+    "                         \"--records-per-piece\")",
+    "                 residues",
+    "                       - number of residues, i.e. bytes of records",
+    "                         excluding headers (FASTA, FASTQ) and newlines.",
+    "                         For FASTQ only sequence lines are counted",
+    "                 compressed",
+    "                       - size of compressed output files. Requires",
+    "                         \"--compress\" and \"--piece-size\". Compressed size",
+    "                         is known only after data is compressed, so each",
+    "                         piece is cut by the compression ratio observed so",
+    "                         far. Compression is then synchronized with writing",
+    "                         after each chunk",
+    "               Balancing by records or residues requires \"-n\" and is",
+    "               supported only by the \"rw\" and \"pipeline\" engines",
+    "               running in a single thread. The input is weighed by an",
+    "               additional pass over it before splitting (see",
+    "               \"--balance-sample\")",
+    "       --balance-sample",
+    "               Estimate total number of records or residues by weighing",
+    "               only this amount of data, taken in chunks evenly spread",
+    "               over the input, instead of weighing the whole input. Units",
+    "               may be used as for \"--cs\". Not supported for compressed",
+    "               input",
+    "       --distribute",
+    "               Deal records to \"-n\" output files one by one instead of",
+    "               cutting the input into contiguous pieces:",
+    "                 round-robin",
+    "                      - records are dealt in turn",
+    "                 hash - records are dealt by a hash of their keys. The key",
+    "                        is the identifier for FASTA and FASTQ (the header",
+    "                        up to the first whitespace) and the whole record",
+    "                        for other formats. Records with the same key land",
+    "                        in the same file",
+    "               Order of records is kept inside each file. The input may be",
+    "               a pipe (\"-\" stands for the standard input). Supported only",
+    "               by the \"rw\" engine without direct I/O, compressed output,",
+    "               fixed-size records and balancing by anything but bytes",
+    "       --plan-only",
+    "               Don't copy any data. Only find bounds of pieces (reading",
+    "               small windows of the input file around projected bounds)",
+    "               and write a manifest of the pieces to the output directory:",
+    "               \"<file name>.manifest\" (text) and",
+    "               \"<file name>.manifest.bin\" (binary). The manifest gives",
+    "               offset, length and number of records of each piece inside",
+    "               the input file. Number of records is known only for",
+    "               fixed-size records and is \"-1\" otherwise. Requires \"-n\"",
+    "               and an uncompressed input file. Not compatible with",
+    "               compressed output, distribution of records, direct I/O and",
+    "               balancing by anything but bytes",
+    "       --incremental",
+    "               Split a growing input file incrementally. The manifest of",
+    "               the pieces (see \"--plan-only\") is kept in the output",
+    "               directory. Each next run splits only the data appended",
+    "               since the previous run: the last piece is written again",
+    "               together with the new data (so it's topped up), and new",
+    "               pieces are added. The end of the data split before is",
+    "               checked to be unchanged. Requires \"--piece-size\" or",
+    "               \"--records-per-piece\" and an uncompressed input file",
+    "       --stats <format>",
+    "               Print statistics of the split to the standard error when",
+    "               it's finished. The only format is \"json\" (a single line).",
+    "               Reported are time, number of calls and amount of data of",
+    "               each phase (reading, searching for bounds, moving data",
+    "               inside the buffer, writing, zero-copy transfers, syncing),",
+    "               latency histograms of I/O calls, distances between",
+    "               projected and found bounds of pieces, sizes of pieces",
+    "               with their imbalance, and peak memory taken by data",
+    "               buffers",
+    "       --progress",
+    "               Print a progress line to the standard error once a second:",
+    "               amount of data split, throughput and, if size of the input",
+    "               is known, the estimated time left",
+    "       --sync <mode>",
+    "               When output files are synced to persistent store:",
+    "                 each - each piece is synced before the next one is",
+    "                        started. A piece reported as written survives",
+    "                        a crash of the system. This is the default",
+    "                 deferred",
+    "                      - writeback of a piece is started as soon as it's",
+    "                        written, and pieces are synced by a pool of",
+    "                        threads while next pieces are written",
+    "                 end  - all pieces are synced in parallel at the end",
+    "                 none - pieces are not synced. They survive a crash of",
+    "                        the tool, but not a crash of the system",
+    "               With \"deferred\" and \"end\" all pieces survive a crash",
+    "               of the system once the tool exits successfully. In all",
+    "               modes but \"none\" the output directory is synced at the",
+    "               end",
+    " ",
+    "Input files compressed with gzip or BGZF are recognized automatically and",
+    "decompressed on the fly. BGZF blocks are decompressed in parallel (see",
+    "\"-j\"), plain gzip is decompressed by a single thread ahead of writing.",
+    "Pieces are balanced by the size of decompressed data and are written",
+    "uncompressed. To find the size, plain gzip input is decompressed twice when",
+    "\"-n\" is used (\"--piece-size\" avoids that). Compressed input is supported",
+    "only by the \"rw\" engine without direct I/O. Compressed standard input is",
+    "not recognized",
+    " ",
+    "Several input files are split as a single input, as if they were concatenated",
+    "in the order given. Pieces are balanced over all the files, and a piece may",
+    "span several files. Each file should end with a complete record. The next",
+    "file is read ahead while the current one is split. Compressed and",
+    "uncompressed files may be mixed. Output files are named after the first",
+    "input file. Several input files are supported only by the \"rw\" engine",
+    "without direct I/O, sampling (\"--balance-sample\"), plan-only and",
+    "incremental modes",
+    ""
+};
+
+/**
+ * Get help message for this program. Lines of the message end with newlines
+ */
+static std::string split_GetHelp( const char *const prog_name)
+{
+    std::string help;
+
+    for ( int i = 0; ; i++ )
+    {
+        if ( !strlen( usage_format[i]) )
+        {
+            break;
+        }
+
+        std::vector<char> line( strlen( usage_format[i]) + strlen( prog_name) + 1);
+
+        snprintf( line.data(), line.size(), usage_format[i], prog_name);
+        help += line.data();
+        help += "\n";
+    }
+
+    for ( int i = 0; ; i++ )
+    {
+        if ( !strlen( usage_options[i]) )
+        {
+            break;
+        }
+
+        help += usage_options[i];
+        help += "\n";
+    }
+
+    return help;
+}
+
+/**
+ * Check if 'strtol' conversion was successful
+ */
+bool split_IsStrtolOK( char first_symb, int err_no, char curr_symb, char base)
+{
+    SPLIT_ASSERT( (base > 1) && (base < 11));
+
+    /* Here we don't allow leading '+' or '-' which is normally
+       allowed by 'strtol' */
+    bool check_res = (first_symb < '0')
+                     || (first_symb > '0' + base - 1)
+                     || (err_no == ERANGE)
+                     || (curr_symb != '\0');
+
+    return !check_res;
+}
+
+/**
+ * Derive default chunk size from the input file
+ *
+ * The chunk is a fixed number of preferred I/O blocks of the file
+ * ("st_blksize"). If the file resides on a block device, the chunk is rounded
+ * up to a multiple of the maximum size of a request to the device, so that
+ * reads of chunks are not split into partial requests
+ */
+static int64_t split_GetDefaultChunkSize( const std::string & input_path)
+{
+    struct stat input_stat;
+    int res = (input_path == "-") ? fstat( STDIN_FILENO, &input_stat)
+                                  : stat( input_path.c_str(), &input_stat);
+
+    if ( (res == -1) || (input_stat.st_blksize <= 0) )
+    {
+        return SPLIT_BUFFER_SIZE_DEFAULT;
+    }
+
+    int64_t chunk_size = (int64_t)input_stat.st_blksize * SPLIT_BLOCKS_PER_CHUNK;
+    /* Queue limits belong to a whole disk. Partitions refer to them through
+       the parent device */
+    const char *queue_paths[] = {"/sys/dev/block/%u:%u/queue/max_sectors_kb",
+                                 "/sys/dev/block/%u:%u/../queue/max_sectors_kb"};
+
+    for ( int i = 0; i < 2; i++ )
+    {
+        char path[100];
+        int64_t request_kb = 0;
+
+        snprintf( path, sizeof( path), queue_paths[i], major( input_stat.st_dev),
+                  minor( input_stat.st_dev));
+
+        FILE *file = fopen( path, "r");
+
+        if ( !file )
+        {
+            continue;
+        }
+
+        if ( (fscanf( file, "%ld", &request_kb) == 1) && (request_kb > 0) )
+        {
+            chunk_size = (chunk_size + request_kb * 1024 - 1) / (request_kb * 1024)
+                         * (request_kb * 1024);
+        }
+
+        fclose( file);
+
+        break;
+    }
+
+    return std::min( std::max( chunk_size, (int64_t)SPLIT_BUFFER_SIZE_MIN),
+                     (int64_t)SPLIT_BUFFER_SIZE_MAX);
+}
+
+/**
+ * Parse size of data. The size may be provided in different units: 512B, 4K,
+ * 8M, 1G. If units identifier is omitted, byte units are implied. "name" is
+ * used in error messages
+ */
+int64_t split_ParseSize( const char *arg, const char *name, int64_t max_size)
+{
+    std::string arg_copy( arg);
+    char unit = 0;
+    char buff[200];
+
+    /* Check if units indentifier was provided */
+    if ( arg_copy.back() < '0' || arg_copy.back() > '9' )
+    {
+        /* Save units identifier */
+        unit = arg_copy.back();
+        /* Delete units identifier from the string */
+        arg_copy.erase( arg_copy.size() - 1, 1);
+    }
+
+    char *c_ptr = 0;
+    int64_t size = strtol( arg_copy.c_str(), &c_ptr, 10);
+
+    if ( !split_IsStrtolOK( arg_copy.front(), errno, *c_ptr, 10) )
+    {
+        snprintf( buff, sizeof( buff), "Integer with units is expected for %s", name);
+        split_FailWithAssist( buff);
+    }
+
+    int shift_val = 0;
+
+    switch ( unit )
+    {
+        /* Units is byte or units wasn't provided */
+        case 0:
+        case 'b':
+        case 'B':
+            break;
+
+        /* Kilobytes */
+        case 'k':
+        case 'K':
+            shift_val = 10;
+
+            break;
+
+        /* Megabytes */
+        case 'm':
+        case 'M':
+            shift_val = 20;
+
+            break;
+
+        /* Gigabytes */
+        case 'g':
+        case 'G':
+            shift_val = 30;
+
+            break;
+
+        default:
+            snprintf( buff, sizeof( buff), "Unexpected units identifier for %s", name);
+            split_FailWithAssist( buff);
+    }
+
+    if ( size > (max_size >> shift_val) )
+    {
+        SPLIT_ERROR( "Value of %s is too big. Maximum value is %ld bytes", name,
+                     max_size);
+    }
+
+    return size << shift_val;
+}
+
+/**
+ * Initialize options
+ */
+int split_InitOpts( split_Opts_t *opts)
+{
+    opts->format = split_formats;
+    opts->compression = SPLIT_COMPRESSION_NONE;
+    /* Chunk size is derived from the input file if it's not set */
+    opts->buffer_size = 0;
+    opts->max_memory = SPLIT_MAX_MEMORY_DEFAULT;
+    opts->num_pieces = 0;
+    opts->piece_size = 0;
+    opts->num_threads = 1;
+    opts->engine = SPLIT_ENGINE_RW;
+    opts->ring_depth = SPLIT_RING_DEPTH_DEFAULT;
+    opts->is_direct = false;
+    opts->buffer_layout = SPLIT_BUFFER_MIRROR;
+    opts->record_size = 0;
+    opts->header_size = 0;
+    opts->output_compression = SPLIT_COMPRESSION_NONE;
+    opts->compression_level = Z_DEFAULT_COMPRESSION;
+    opts->balance = SPLIT_BALANCE_BYTES;
+    opts->balance_sample = 0;
+    opts->records_per_piece = 0;
+    opts->distribution = SPLIT_DISTRIBUTE_NONE;
+    opts->is_plan_only = false;
+    opts->is_incremental = false;
+    opts->start_offset = 0;
+    opts->first_piece = 0;
+    opts->is_stats = false;
+    opts->is_progress = false;
+    opts->sync_mode = SPLIT_SYNC_EACH;
+
+    return 0;
+}
+
+/**
+ * Check if bounds of all pieces are planned before the pieces are copied.
+ * Otherwise the input is split in a single pass
+ *
+ * Compressed input can't be read at arbitrary offsets, and compressed output is
+ * produced in a single pass. Then "-j" is used for compression and
+ * decompression
+ */
+static bool split_IsPlanned( const split_Opts_t *opts)
+{
+    return ((opts->num_threads > 1) && !opts->compression && !opts->output_compression
+            && (opts->input_paths.size() == 1))
+           || ((opts->engine != SPLIT_ENGINE_RW) && (opts->engine != SPLIT_ENGINE_PIPELINE));
+}
+
+/**
+ * Parse command line
+ */
+int split_ParseCmdLine( int argc, char *argv[], split_Opts_t *opts)
+{
+    int long_opt_index = -1;
+    int getopt_res = -1;
+
+    /* Parsing may be repeated for another split. Full reinitialization of
+       "getopt_long()" is requested */
+    optind = 0;
+
+    while ( 1 )
+    {
+        /* Arguments start at index "1" after the reinitialization */
+        int curr_optind = std::max( optind, 1);
+
+        getopt_res = getopt_long( argc, argv, split_short_options_desc.c_str(),
+                                  split_long_options_desc, &long_opt_index);
+
+        /* This return code means the input was fully parsed */
+        if ( getopt_res == -1 )
+        {
+            break;
+        }
+
+        /* Buffer for error messages */
+        char buff[200];
+
+        switch ( getopt_res )
+        {
+            /* Output directory */
+            case 'd':
+                opts->output_dir = std::string( optarg);
+
+                break;
+
+            /* Output file base name */
+            case 'f':
+                opts->output_file = std::string( optarg);
+
+                break;
+
+            /* Chunk size */
+            case 'c':
+                /* The programm uses internally a buffer of double size */
+                opts->buffer_size = split_ParseSize( optarg, "chunk size", INT64_MAX / 2);
+
+                break;
+
+            /* Limit of memory of grown buffers */
+            case 'M':
+                opts->max_memory = split_ParseSize( optarg, "memory limit", INT64_MAX);
+
+                break;
+
+            /* Size of pieces of an input stream */
+            case 'p':
+                opts->piece_size = split_ParseSize( optarg, "piece size", INT64_MAX);
+
+                if ( !opts->piece_size )
+                {
+                    SPLIT_ERROR( "Piece size should be greater than 0");
+                }
+
+                break;
+
+            /* Format of the input file */
+            case 'F':
+                opts->format = split_FindFormat( optarg);
+
+                if ( !opts->format )
+                {
+                    snprintf( buff, sizeof( buff), "Unknown format: %s", optarg);
+                    split_FailWithAssist( buff);
+                }
+
+                break;
+
+            /* Data moving engine */
+            case 'e':
+                if ( !strcmp( optarg, "rw") )
+                {
+                    opts->engine = SPLIT_ENGINE_RW;
+                } else if ( !strcmp( optarg, "pipeline") )
+                {
+                    opts->engine = SPLIT_ENGINE_PIPELINE;
+                } else if ( !strcmp( optarg, "mmap") )
+                {
+                    opts->engine = SPLIT_ENGINE_MMAP;
+                } else if ( !strcmp( optarg, "copy") )
+                {
+                    opts->engine = SPLIT_ENGINE_COPY;
+                } else if ( !strcmp( optarg, "uring") )
+                {
+                    opts->engine = SPLIT_ENGINE_URING;
+                } else
+                {
+                    snprintf( buff, sizeof( buff), "Unknown engine: %s", optarg);
+                    split_FailWithAssist( buff);
+                }
+
+                break;
+
+            /* Memory-mapping engine */
+            case 'm':
+                opts->engine = SPLIT_ENGINE_MMAP;
+
+                break;
+
+            /* Depth of the ring of buffers */
+            case 'r':
+            {
+                char *c_ptr = 0;
+
+                opts->ring_depth = strtol( optarg, &c_ptr, 10);
+
+                if ( !split_IsStrtolOK( optarg[0], errno, *c_ptr, 10) )
+                {
+                    split_FailWithAssist( "Integer is expected for ring depth");
+                }
+
+                if ( opts->ring_depth < 2 )
+                {
+                    SPLIT_ERROR( "Ring depth should be greater than 1");
+                }
+
+                break;
+            }
+
+            /* Direct I/O */
+            case 'D':
+                opts->is_direct = true;
+
+                break;
+
+            /* Layout of the double-buffer */
+            case 'b':
+                if ( !strcmp( optarg, "mirror") )
+                {
+                    opts->buffer_layout = SPLIT_BUFFER_MIRROR;
+                } else if ( !strcmp( optarg, "halves") )
+                {
+                    opts->buffer_layout = SPLIT_BUFFER_HALVES;
+                } else
+                {
+                    snprintf( buff, sizeof( buff), "Unknown buffer layout: %s",
+                              optarg);
+                    split_FailWithAssist( buff);
+                }
+
+                break;
+
+            /* Size of fixed-size records */
+            case 'R':
+            {
+                char *c_ptr = 0;
+
+                opts->record_size = strtol( optarg, &c_ptr, 10);
+
+                if ( !split_IsStrtolOK( optarg[0], errno, *c_ptr, 10) )
+                {
+                    split_FailWithAssist( "Integer is expected for record size");
+                }
+
+                if ( opts->record_size < 1 )
+                {
+                    SPLIT_ERROR( "Record size should be greater than 0");
+                }
+
+                break;
+            }
+
+            /* Size of the header preceding fixed-size records */
+            case 'H':
+            {
+                char *c_ptr = 0;
+
+                opts->header_size = strtol( optarg, &c_ptr, 10);
+
+                if ( !split_IsStrtolOK( optarg[0], errno, *c_ptr, 10) )
+                {
+                    split_FailWithAssist( "Integer is expected for header size");
+                }
+
+                break;
+            }
+
+            /* Compression of output files */
+            case 'z':
+                if ( !strcmp( optarg, "gzip") )
+                {
+                    opts->output_compression = SPLIT_COMPRESSION_GZIP;
+                } else if ( !strcmp( optarg, "bgzf") )
+                {
+                    opts->output_compression = SPLIT_COMPRESSION_BGZF;
+                } else
+                {
+                    snprintf( buff, sizeof( buff), "Unknown compression: %s", optarg);
+                    split_FailWithAssist( buff);
+                }
+
+                break;
+
+            /* Compression level */
+            case 'L':
+            {
+                char *c_ptr = 0;
+
+                opts->compression_level = strtol( optarg, &c_ptr, 10);
+
+                if ( !split_IsStrtolOK( optarg[0], errno, *c_ptr, 10) )
+                {
+                    split_FailWithAssist( "Integer is expected for compression level");
+                }
+
+                if ( (opts->compression_level < 0) || (opts->compression_level > 9) )
+                {
+                    SPLIT_ERROR( "Compression level should be from 0 to 9");
+                }
+
+                break;
+            }
+
+            /* Measure of piece sizes */
+            case 'B':
+                if ( !strcmp( optarg, "bytes") )
+                {
+                    opts->balance = SPLIT_BALANCE_BYTES;
+                } else if ( !strcmp( optarg, "compressed") )
+                {
+                    opts->balance = SPLIT_BALANCE_COMPRESSED;
+                } else if ( !strcmp( optarg, "records") )
+                {
+                    opts->balance = SPLIT_BALANCE_RECORDS;
+                } else if ( !strcmp( optarg, "residues") )
+                {
+                    opts->balance = SPLIT_BALANCE_RESIDUES;
+                } else
+                {
+                    snprintf( buff, sizeof( buff), "Unknown balance measure: %s",
+                              optarg);
+                    split_FailWithAssist( buff);
+                }
+
+                break;
+
+            /* Amount of data sampled to estimate weight of the input */
+            case 'S':
+                opts->balance_sample = split_ParseSize( optarg, "sample size", INT64_MAX);
+
+                break;
+
+            /* Way of dealing records to output files */
+            case 'T':
+                if ( !strcmp( optarg, "round-robin") )
+                {
+                    opts->distribution = SPLIT_DISTRIBUTE_ROUND_ROBIN;
+                } else if ( !strcmp( optarg, "hash") )
+                {
+                    opts->distribution = SPLIT_DISTRIBUTE_HASH;
+                } else
+                {
+                    snprintf( buff, sizeof( buff), "Unknown distribution mode: %s",
+                              optarg);
+                    split_FailWithAssist( buff);
+                }
+
+                break;
+
+            /* Write a manifest of pieces instead of copying them */
+            case 'P':
+                opts->is_plan_only = true;
+
+                break;
+
+            /* Split only data appended since the previous split */
+            case 'I':
+                opts->is_incremental = true;
+
+                break;
+
+            /* Format of statistics */
+            case 's':
+                if ( strcmp( optarg, "json") )
+                {
+                    snprintf( buff, sizeof( buff), "Unknown statistics format: %s",
+                              optarg);
+                    split_FailWithAssist( buff);
+                }
+
+                opts->is_stats = true;
+
+                break;
+
+            /* Progress line */
+            case 'g':
+                opts->is_progress = true;
+
+                break;
+
+            /* Mode of syncing output files */
+            case 'y':
+                if ( !strcmp( optarg, "each") )
+                {
+                    opts->sync_mode = SPLIT_SYNC_EACH;
+                } else if ( !strcmp( optarg, "deferred") )
+                {
+                    opts->sync_mode = SPLIT_SYNC_DEFERRED;
+                } else if ( !strcmp( optarg, "end") )
+                {
+                    opts->sync_mode = SPLIT_SYNC_END;
+                } else if ( !strcmp( optarg, "none") )
+                {
+                    opts->sync_mode = SPLIT_SYNC_NONE;
+                } else
+                {
+                    snprintf( buff, sizeof( buff), "Unknown sync mode: %s", optarg);
+                    split_FailWithAssist( buff);
+                }
+
+                break;
+
+            /* Number of records in each piece */
+            case 'N':
+            {
+                char *c_ptr = 0;
+
+                opts->records_per_piece = strtol( optarg, &c_ptr, 10);
+
+                if ( !split_IsStrtolOK( optarg[0], errno, *c_ptr, 10) )
+                {
+                    split_FailWithAssist( "Integer is expected for number of records "
+                                          "per piece");
+                }
+
+                if ( opts->records_per_piece < 1 )
+                {
+                    SPLIT_ERROR( "Number of records per piece should be greater than 0");
+                }
+
+                break;
+            }
+
+            /* Number of pieces */
+            case 'n':
+            {
+                char *c_ptr = 0;
+
+                opts->num_pieces = strtol( optarg, &c_ptr, 10);
+
+                if ( !split_IsStrtolOK( optarg[0], errno, *c_ptr, 10) )
+                {
+                    split_FailWithAssist( "Integer is expected for number of pieces");
+                }
+
+                if ( opts->num_pieces < 2 )
+                {
+                    SPLIT_ERROR( "Number of pieces should be greater than 1");
+                }
+
+                break;
+            }
+
+            /* Number of threads */
+            case 'j':
+            {
+                char *c_ptr = 0;
+
+                opts->num_threads = strtol( optarg, &c_ptr, 10);
+
+                if ( !split_IsStrtolOK( optarg[0], errno, *c_ptr, 10) )
+                {
+                    split_FailWithAssist( "Integer is expected for number of threads");
+                }
+
+                if ( opts->num_threads < 1 )
+                {
+                    SPLIT_ERROR( "Number of threads should be greater than 0");
+                }
+
+                break;
+            }
+
+            /* Missing mandatory argument */
+            case ':':
+                snprintf( buff, sizeof( buff),
+                         "Mandatory argument is missing for \"%s\"",
+                         argv[curr_optind]);
+                split_FailWithAssist( buff);
+
+                break;
+
+            /* Unknow option */
+            case '?':
+                snprintf( buff, sizeof( buff), "Unknown option: %s", argv[curr_optind]);
+                split_FailWithAssist( buff);
+
+                break;
+
+            /* Unexpected return value of 'getopt' */
+            default:
+                SPLIT_ASSERT( 0);
+        }
+    }
+
+    if ( optind == argc )
+    {
+        split_FailWithAssist( "Name of input file is required");
+    }
+
+    if ( !opts->num_pieces && !opts->piece_size && !opts->records_per_piece )
+    {
+        split_FailWithAssist( "Number of pieces, piece size or number of records per "
+                              "piece is required");
+    }
+
+    if ( (opts->num_pieces != 0) + (opts->piece_size != 0)
+         + (opts->records_per_piece != 0) > 1 )
+    {
+        split_FailWithAssist( "Only one of number of pieces, piece size and number "
+                              "of records per piece can be used");
+    }
+
+    opts->input_path = std::string( argv[optind]);
+    opts->input_paths.assign( argv + optind, argv + argc);
+
+    if ( (opts->input_paths.size() > 1)
+         && (std::find( opts->input_paths.begin(), opts->input_paths.end(), "-")
+             != opts->input_paths.end()) )
+    {
+        split_FailWithAssist( "The standard input can't be split together with other "
+                              "input files");
+    }
+
+    if ( (opts->output_file).empty() && (opts->input_path == "-") )
+    {
+        split_FailWithAssist( "Basis for output file names (\"--of\") is required "
+                              "when reading the standard input");
+    }
+
+    if ( (opts->output_file).empty() )
+    {
+        char *buff = (char *)malloc( opts->input_path.size() + 1);
+
+        if ( !buff )
+        {
+            SPLIT_ERROR( "Couldn't allocate memory for a temporary buffer");
+        }
+
+        strcpy( buff, opts->input_path.c_str());
+        /* Use input file name as the base name for pieces */
+        opts->output_file = basename( buff);
+        free( buff);
+    }
+
+    if ( (opts->output_dir).empty() )
+    {
+        /* Use current directory for output */
+        opts->output_dir = ".";
+    }
+
+    if ( !opts->buffer_size )
+    {
+        opts->buffer_size = split_GetDefaultChunkSize( opts->input_path);
+    }
+
+    /* Detect compression of the input file. If the file can't be opened, the
+       error is reported when it's opened for splitting. Compression of several
+       input files is detected for each of them when it's read */
+    if ( (opts->input_path != "-") && (opts->input_paths.size() == 1) )
+    {
+        int fd = open( (opts->input_path).c_str(), O_RDONLY);
+
+        if ( fd != -1 )
+        {
+            opts->compression = split_DetectCompression( fd);
+            close( fd);
+        }
+    }
+
+    if ( (opts->num_threads > 1) && !opts->output_compression
+         && ((opts->engine == SPLIT_ENGINE_PIPELINE)
+             || (opts->engine == SPLIT_ENGINE_URING)) )
+    {
+        split_FailWithAssist( "Several threads can't be used with the pipeline "
+                              "and uring engines");
+    }
+
+    if ( opts->is_direct
+         && ((opts->num_threads > 1) || (opts->engine != SPLIT_ENGINE_RW)) )
+    {
+        split_FailWithAssist( "Direct I/O is supported only by the \"rw\" engine "
+                              "running in a single thread");
+    }
+
+    if ( opts->header_size && !opts->record_size )
+    {
+        split_FailWithAssist( "Header size requires record size");
+    }
+
+    if ( opts->compression
+         && ((opts->engine != SPLIT_ENGINE_RW) || opts->is_direct) )
+    {
+        split_FailWithAssist( "Compressed input is supported only by the \"rw\" "
+                              "engine without direct I/O");
+    }
+
+    if ( opts->output_compression
+         && (((opts->engine != SPLIT_ENGINE_RW) && (opts->engine != SPLIT_ENGINE_PIPELINE))
+             || opts->is_direct) )
+    {
+        split_FailWithAssist( "Compressed output is supported only by the \"rw\" "
+                              "and \"pipeline\" engines without direct I/O");
+    }
+
+    if ( (opts->balance == SPLIT_BALANCE_COMPRESSED) && !opts->output_compression )
+    {
+        split_FailWithAssist( "Balancing by compressed size requires compressed "
+                              "output");
+    }
+
+    if ( (opts->balance == SPLIT_BALANCE_COMPRESSED) && !opts->piece_size )
+    {
+        split_FailWithAssist( "Balancing by compressed size requires piece size "
+                              "(\"--piece-size\"). Total compressed size is not "
+                              "known in advance");
+    }
+
+    if ( opts->output_compression )
+    {
+        opts->output_extension = ".gz";
+    }
+
+    if ( (opts->piece_size || opts->records_per_piece)
+         && (split_IsPlanned( opts) || (opts->engine != SPLIT_ENGINE_RW)
+             || opts->is_direct) )
+    {
+        split_FailWithAssist( "Piece size and number of records per piece are "
+                              "supported only by the \"rw\" engine running in a "
+                              "single thread without direct I/O");
+    }
+
+    if ( ((opts->balance == SPLIT_BALANCE_RECORDS)
+          || (opts->balance == SPLIT_BALANCE_RESIDUES))
+         && (!opts->num_pieces || split_IsPlanned( opts)) )
+    {
+        split_FailWithAssist( "Balancing by records or residues requires number of "
+                              "pieces and is supported only by the \"rw\" and "
+                              "\"pipeline\" engines running in a single thread");
+    }
+
+    if ( opts->record_size
+         && (opts->records_per_piece || (opts->balance == SPLIT_BALANCE_RECORDS)
+             || (opts->balance == SPLIT_BALANCE_RESIDUES)) )
+    {
+        split_FailWithAssist( "Fixed-size records are balanced by bytes. Use piece "
+                              "size to put a fixed number of records to a piece");
+    }
+
+    if ( opts->balance_sample && opts->compression )
+    {
+        split_FailWithAssist( "Compressed input can't be sampled");
+    }
+
+    if ( (opts->input_paths.size() > 1)
+         && ((opts->engine != SPLIT_ENGINE_RW) || opts->is_direct || opts->balance_sample
+             || opts->is_plan_only || opts->is_incremental) )
+    {
+        split_FailWithAssist( "Several input files are supported only by the \"rw\" "
+                              "engine without direct I/O, sampling, plan-only and "
+                              "incremental modes");
+    }
+
+    if ( opts->distribution && !opts->num_pieces )
+    {
+        split_FailWithAssist( "Distribution of records requires number of pieces");
+    }
+
+    if ( opts->distribution
+         && ((opts->engine != SPLIT_ENGINE_RW) || opts->is_direct
+             || opts->output_compression || opts->record_size
+             || (opts->balance != SPLIT_BALANCE_BYTES)) )
+    {
+        split_FailWithAssist( "Distribution of records is supported only by the "
+                              "\"rw\" engine without direct I/O, compressed output, "
+                              "fixed-size records and balancing");
+    }
+
+    if ( opts->is_plan_only && (!opts->num_pieces || opts->compression) )
+    {
+        split_FailWithAssist( "Plan-only mode requires number of pieces and an "
+                              "uncompressed input file");
+    }
+
+    if ( opts->is_plan_only
+         && (opts->output_compression || opts->distribution || opts->is_direct
+             || (opts->balance != SPLIT_BALANCE_BYTES)) )
+    {
+        split_FailWithAssist( "Plan-only mode can't be combined with compressed "
+                              "output, distribution of records, direct I/O and "
+                              "balancing");
+    }
+
+    if ( opts->is_incremental
+         && ((!opts->piece_size && !opts->records_per_piece) || opts->compression
+             || (opts->input_path == "-")) )
+    {
+        split_FailWithAssist( "Incremental mode requires piece size or number of "
+                              "records per piece, and an uncompressed input file");
+    }
+
+    /* The header together with the first record is treated as an element. So,
+       it should fit into a chunk as any other element */
+    if ( opts->header_size + opts->record_size > opts->buffer_size )
+    {
+        SPLIT_ERROR( "Record size (plus header size) should not exceed chunk size");
+    }
+
+    return 0;
+}
+
+/**
+ * Calculate number of decimal digits needed to write down N-1
+ */
+static int split_CalcNumWidth( int64_t num)
+{
+    int num_digits = 0;
+
+    SPLIT_ASSERT( num > 1);
+    num--;
+
+    while ( num )
+    {
+        num_digits++;
+        num /= 10;
+    }
+
+    return num_digits;
+}
+
+/**
+ * Get size of an input file
+ */
+int64_t split_GetInputSize( int fd)
+{
+    /* Check that the file is at zero offset. Otherwise we would need
+       to save current offset to return to it later */
+    SPLIT_ASSERT( !lseek( fd, 0, SEEK_CUR));
+
+    char err_msg[500];
+    struct stat input_stat;
+
+    if ( fstat( fd, &input_stat) == -1 )
+    {
+        SPLIT_ERROR( "Cannot get status of input file: %s",
+                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+    }
+
+    /* Size of pipes and character devices is not known in advance */
+    if ( S_ISFIFO( input_stat.st_mode) || S_ISSOCK( input_stat.st_mode)
+         || S_ISCHR( input_stat.st_mode) )
+    {
+        SPLIT_ERROR( "Input file is a stream. Use \"--piece-size\" to split it");
+    }
+
+    int64_t input_size = lseek( fd, 0, SEEK_END);
+
+    if ( input_size == -1 )
+    {
+        SPLIT_ERROR( "Cannot seek input file: %s",
+                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+    }
+
+    /* Return to the beginning of the file */
+    if ( lseek( fd, 0, SEEK_SET) == -1 )
+    {
+        SPLIT_ERROR( "Cannot seek input file: %s",
+                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+    }
+
+    return input_size;
+}
+
+/**
+ * Get name of the output file of a piece (without the directory)
+ */
+static std::string split_GetPieceFileName( const std::string & file_name,
+                                           const std::string & extension,
+                                           int num_digits,
+                                           int64_t piece_num)
+{
+    char buff[64];
+
+    snprintf( buff, sizeof( buff), "%0*ld", num_digits, piece_num);
+
+    return file_name + "." + buff + extension;
+}
+
+/**
+ * Get path of the output file of a piece
+ */
+static std::string split_GetPieceName( const std::string & dir_name,
+                                       const std::string & file_name,
+                                       const std::string & extension,
+                                       int num_digits,
+                                       int64_t piece_num)
+{
+    return dir_name + "/" + split_GetPieceFileName( file_name, extension, num_digits,
+                                                    piece_num);
+}
+
+/**
+ * Create output file for a new piece. If a sink is set, the piece is started
+ * in the sink (see "sink.cpp")
+ */
+static int split_StartNewPiece( const std::string & dir_name,
+                                const std::string & file_name,
+                                const std::string & extension,
+                                int num_digits,
+                                int64_t piece_num)
+{
+    if ( split_sink_state->sink )
+    {
+        return split_StartSinkPiece( split_GetPieceFileName( file_name, extension,
+                                                             num_digits, piece_num),
+                                     piece_num);
+    }
+
+    std::string output_name = split_GetPieceName( dir_name, file_name, extension,
+                                                  num_digits, piece_num);
+    char err_msg[500];
+    int output_fd = open( output_name.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0644);
+
+    if ( output_fd == -1 )
+    {
+        SPLIT_ERROR( "Cannot create output file \"%s\": %s", output_name.c_str(),
+                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+    }
+
+    split_AddSyncedFile( output_name);
+
+    return output_fd;
+}
+
+/**
+ * Report that a piece was written. "piece_size" is "-1" if size of the piece
+ * is unknown
+ */
+static void split_ReportPiece( int64_t piece_num, int64_t piece_size)
+{
+    char prefix[100];
+
+    split_RecordPiece( piece_num, piece_size);
+    snprintf( prefix, sizeof( prefix), "Piece %ld written. Size: ", piece_num + 1);
+
+    if ( piece_size != -1 )
+    {
+        char units = 0;
+        double value = 0;
+
+        if ( piece_size / (1024 * 1024 * 1024) )
+        {
+            value = piece_size / (1024 * 1024 * 1024);
+            units = 'G';
+        } else if ( piece_size / (1024 * 1024) )
+        {
+            value = piece_size / (1024 * 1024);
+            units = 'M';
+        } else if ( piece_size / 1024 )
+        {
+            value = piece_size / 1024;
+            units = 'K';
+        }
+
+        if ( units )
+        {
+            SPLIT_OUT( "%s%.1f%c (%ld bytes)", prefix, value, units, piece_size);
+        } else
+        {
+            SPLIT_OUT( "%s%ld bytes", prefix, piece_size);
+        }
+    } else
+    {
+        SPLIT_OUT( "%sunknown", prefix);
+    }
+}
+
+/**
+ * Sync output file to persistent store (or schedule that, depending on the
+ * mode of syncing) and close
+ */
+static int split_FinalizePiece( int fd, int64_t piece_num)
+{
+    if ( split_sink_state->sink )
+    {
+        split_ReportPiece( piece_num, split_FinishSinkPiece( fd));
+
+        return 0;
+    }
+
+    int64_t piece_size = lseek( fd, 0, SEEK_END);
+
+    split_SyncPiece( fd, piece_size);
+    split_ReportPiece( piece_num, piece_size);
+
+    return 0;
+}
+
+/**
+ * Close output file of a piece left unfinished by an error. The file is left
+ * in place with the data written. Preallocated space beyond the data is
+ * released (errors are ignored)
+ */
+static void split_AbandonPiece( int fd)
+{
+    if ( split_sink_state->sink )
+    {
+        split_sink_state->sizes.erase( fd);
+    } else
+    {
+        struct stat output_stat;
+
+        if ( !fstat( fd, &output_stat) && (ftruncate( fd, output_stat.st_size) == -1) )
+        {
+            /* Only space is not released. Failures are not important */
+        }
+
+        close( fd);
+    }
+}
+
+/**
+ * Read chunk of data from an input stream to upper half of the double-buffer
+ *
+ * Reads from pipes may return less data than requested. So reading is
+ * repeated until the chunk is full or the end of the stream is reached. If
+ * "inflater" is not NULL, the stream is decompressed data of the input file
+ */
+static int64_t split_FillUpperBuffHalfFromStream( int fd,
+                                                  split_Inflater_t *inflater,
+                                                  char *double_buff,
+                                                  int64_t buff_size)
+{
+    char err_msg[500];
+    int64_t bytes_read = 0;
+
+    if ( inflater )
+    {
+        int64_t start = split_StartTimer();
+
+        bytes_read = split_ReadInflated( inflater, double_buff + buff_size, buff_size);
+        split_StopTimer( SPLIT_PHASE_READ, start, bytes_read);
+
+        return bytes_read;
+    }
+
+    while ( bytes_read < buff_size )
+    {
+        int64_t start = split_StartTimer();
+        int64_t res = read( fd, double_buff + buff_size + bytes_read,
+                            buff_size - bytes_read);
+
+        split_StopTimer( SPLIT_PHASE_READ, start, std::max( res, (int64_t)0));
+
+        if ( res == -1 )
+        {
+            if ( errno == EINTR )
+            {
+                continue;
+            }
+
+            SPLIT_ERROR( "Cannot read data from the input stream: %s",
+                         SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+        } else if ( !res )
+        {
+            break;
+        }
+
+        bytes_read += res;
+    }
+
+    return bytes_read;
+}
+
+/**
+ * Read chunk of decompressed data of an input file to upper half of the
+ * double-buffer
+ */
+static int64_t split_FillUpperBuffHalfFromInflater( split_Inflater_t *inflater,
+                                                    char *double_buff,
+                                                    int64_t buff_size,
+                                                    int64_t bytes_available)
+{
+    int64_t io_size = std::min( buff_size, bytes_available);
+    int64_t start = split_StartTimer();
+    int64_t bytes_read = split_ReadInflated( inflater, double_buff + buff_size,
+                                             io_size);
+
+    split_StopTimer( SPLIT_PHASE_READ, start, bytes_read);
+
+    if ( bytes_read != io_size )
+    {
+        SPLIT_ERROR( "Decompressed %ld bytes of the input file. %ld bytes were "
+                     "expected. Was the file modified?", bytes_read, io_size);
+    }
+
+    return bytes_read;
+}
+
+/**
+ * Account the end of an input stream. Size of the input becomes known
+ *
+ * Until then the input is assumed to be of maximum possible size. Now the
+ * amounts of remaining data are corrected. "active_data_size" is the amount
+ * of data in the double-buffer, i.e. all the data that is not written yet
+ */
+static void split_EndStream( int64_t active_data_size,
+                             int64_t *input_size,
+                             int64_t *bytes_available,
+                             int64_t *bytes_not_read)
+{
+    *input_size -= *bytes_available - active_data_size;
+    *bytes_available = active_data_size;
+    *bytes_not_read = 0;
+}
+
+/**
+ * Read chunk of data from an input file to upper half of the double-buffer
+ *
+ * "io_align" is alignment of read size required by direct I/O. It's "1" if
+ * direct I/O is not used
+ */
+static int64_t split_FillUpperBuffHalfFromInput( int fd,
+                                                 char *double_buff,
+                                                 int64_t buff_size,
+                                                 int64_t bytes_available,
+                                                 int64_t io_align)
+{
+    if ( !bytes_available )
+    {
+        /* End of input file was reached */
+        return 0;
+    }
+
+    int64_t io_size = buff_size;
+
+    /* We always read data in chunks of fixed size, except maybe the last
+       read of input file (because size of input file may not be multiple
+       of chunk size). So, even if amount of data needed to complete current
+       piece is less than chunk size, we still read full chunk. If we don't
+       add it fully to the current piece, remaining data will be used to
+       start next piece */
+    if ( io_size > bytes_available )
+    {
+        io_size = bytes_available;
+    }
+
+    /* With direct I/O even the last read of input file must be of aligned
+       size. The read returns less data in this case */
+    int64_t aligned_io_size = (io_size + io_align - 1) / io_align * io_align;
+
+    SPLIT_ASSERT( aligned_io_size <= buff_size);
+
+    char err_msg[500];
+    int64_t start = split_StartTimer();
+    int64_t bytes_read = read( fd, double_buff + buff_size, aligned_io_size);
+
+    split_StopTimer( SPLIT_PHASE_READ, start, std::max( bytes_read, (int64_t)0));
+
+    if ( bytes_read == -1 )
+    {
+        SPLIT_ERROR( "Cannot read data from the input file: %s",
+                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+    } else if ( bytes_read != io_size )
+    {
+        SPLIT_ERROR( "Read %ld bytes from the input file. %ld bytes were expected. "
+                     "Is it a regular file?", bytes_read, io_size);
+    }
+
+    return bytes_read;
+}
+
+/**
+ * Ring of double-buffers used by the pipeline engine
+ *
+ * A reader thread fills upper halves of the double-buffers with consecutive
+ * chunks of the input file. The splitting loop takes filled double-buffers
+ * in the same order and returns them to the ring when they are not needed
+ * anymore. The reader fills a double-buffer only after it was returned
+ */
+typedef struct
+{
+    /* Double-buffers */
+    std::vector<char *> buffs;
+    /* Amount of data read to the upper half of each double-buffer */
+    std::vector<int64_t> sizes;
+    /* Number of chunks read by the reader thread */
+    int64_t num_filled;
+    /* Number of chunks taken by the splitting loop */
+    int64_t num_taken;
+    /* Number of chunks returned to the ring */
+    int64_t num_released;
+    /* Indicator that the reader should stop */
+    bool is_stopped;
+    std::mutex lock;
+    std::condition_variable cond;
+    std::thread reader;
+} split_Ring_t;
+
+/**
+ * Allocate double-buffers of the ring and start the reader thread
+ */
+static void split_StartRing( split_Ring_t *ring,
+                             int64_t depth,
+                             int fd,
+                             int64_t buff_size,
+                             int64_t input_size)
+{
+    for ( int64_t i = 0; i < depth; i++ )
+    {
+        char *buff = (char *)malloc( 2 * buff_size);
+
+        if ( !buff )
+        {
+            SPLIT_ERROR( "Couldn't allocate internal buffer of size %ld",
+                         2 * buff_size);
+        }
+
+        ring->buffs.push_back( buff);
+        ring->sizes.push_back( 0);
+    }
+
+    ring->num_filled = ring->num_taken = ring->num_released = 0;
+    ring->is_stopped = false;
+    ring->reader = split_StartWorker( &ring->lock, &ring->cond, [=]()
+    {
+        int64_t bytes_not_read = input_size;
+
+        while ( bytes_not_read )
+        {
+            int64_t slot = ring->num_filled % depth;
+
+            {
+                std::unique_lock<std::mutex> guard( ring->lock);
+
+                while ( (ring->num_filled - ring->num_released == depth)
+                        && !ring->is_stopped )
+                {
+                    ring->cond.wait( guard);
+                }
+
+                if ( ring->is_stopped )
+                {
+                    return;
+                }
+            }
+
+            /* The slot is owned by the reader now. No need to hold the lock */
+            int64_t bytes_read = split_FillUpperBuffHalfFromInput( fd,
+                                                                   ring->buffs[slot],
+                                                                   buff_size,
+                                                                   bytes_not_read,
+                                                                   1);
+            bytes_not_read -= bytes_read;
+
+            std::lock_guard<std::mutex> guard( ring->lock);
+
+            ring->sizes[slot] = bytes_read;
+            ring->num_filled++;
+            ring->cond.notify_all();
+        }
+    });
+}
+
+/**
+ * Take next filled double-buffer from the ring
+ *
+ * Return value: the double-buffer. Amount of data in its upper half is
+ *               returned through "bytes_read"
+ */
+static char *split_TakeFromRing( split_Ring_t *ring, int64_t *bytes_read)
+{
+    std::unique_lock<std::mutex> guard( ring->lock);
+
+    while ( (ring->num_filled == ring->num_taken) && !split_workers->is_failed )
+    {
+        ring->cond.wait( guard);
+    }
+
+    split_CheckWorkers();
+
+    int64_t slot = ring->num_taken++ % ring->buffs.size();
+
+    *bytes_read = ring->sizes[slot];
+
+    return ring->buffs[slot];
+}
+
+/**
+ * Return the oldest taken double-buffer to the ring
+ */
+static void split_ReleaseToRing( split_Ring_t *ring)
+{
+    std::lock_guard<std::mutex> guard( ring->lock);
+
+    SPLIT_ASSERT( ring->num_released < ring->num_taken);
+    ring->num_released++;
+    ring->cond.notify_all();
+}
+
+/**
+ * Stop the reader thread and free double-buffers of the ring. It may be
+ * repeated
+ */
+static void split_StopRing( split_Ring_t *ring)
+{
+    {
+        std::lock_guard<std::mutex> guard( ring->lock);
+
+        ring->is_stopped = true;
+        ring->cond.notify_all();
+    }
+
+    if ( ring->reader.joinable() )
+    {
+        ring->reader.join();
+    }
+
+    for ( size_t i = 0; i < ring->buffs.size(); i++ )
+    {
+        free( ring->buffs[i]);
+    }
+
+    ring->buffs.clear();
+}
+
+/**
+ * Allocate double-buffer inside a mirrored ring
+ *
+ * Memory of double chunk size (rounded up to a page bound) is mapped twice
+ * back-to-back. So a byte at address "ring + i" and a byte at address
+ * "ring + ring_size + i" are the same byte. Instead of copying active data
+ * from the upper half of the double-buffer to the lower half, the
+ * double-buffer may be moved forward inside the ring. Active data stays in
+ * place and still looks contiguous, and the new upper half reuses memory
+ * which data was already written out
+ *
+ * Return value: start of the ring, or NULL if it can't be created. Size of
+ *               the ring is returned through "ring_size"
+ */
+static char *split_AllocMirroredBuff( int64_t buff_size, int64_t *ring_size)
+{
+    int64_t page_size = sysconf( _SC_PAGESIZE);
+    int64_t size = (2 * buff_size + page_size - 1) / page_size * page_size;
+    int fd = memfd_create( "split", MFD_CLOEXEC);
+
+    if ( fd == -1 )
+    {
+        return NULL;
+    }
+
+    if ( ftruncate( fd, size) == -1 )
+    {
+        close( fd);
+
+        return NULL;
+    }
+
+    /* Reserve address space for both mappings first, so they are guaranteed
+       to be adjacent */
+    char *ring = (char *)mmap( NULL, 2 * size, PROT_NONE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if ( ring == MAP_FAILED )
+    {
+        close( fd);
+
+        return NULL;
+    }
+
+    if ( (mmap( ring, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+                fd, 0) == MAP_FAILED)
+         || (mmap( ring + size, size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) )
+    {
+        munmap( ring, 2 * size);
+        close( fd);
+
+        return NULL;
+    }
+
+    /* Mappings keep the memory alive */
+    close( fd);
+    *ring_size = size;
+
+    return ring;
+}
+
+/**
+ * Map input file to memory
+ */
+static const char *split_MapInput( int fd, int64_t input_size)
+{
+    char err_msg[500];
+    void *map = mmap( NULL, input_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    if ( map == MAP_FAILED )
+    {
+        SPLIT_ERROR( "Cannot map input file to memory: %s",
+                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+    }
+
+    return (const char *)map;
+}
+
+/**
+ * Read data from a given offset of an input file
+ */
+static int64_t split_ReadInputAt( int fd, char *buff, int64_t size, int64_t offset)
+{
+    char err_msg[500];
+    int64_t bytes_read = 0;
+
+    while ( bytes_read < size )
+    {
+        int64_t start = split_StartTimer();
+        int64_t res = pread( fd, buff + bytes_read, size - bytes_read,
+                             offset + bytes_read);
+
+        split_StopTimer( SPLIT_PHASE_READ, start, std::max( res, (int64_t)0));
+
+        if ( res == -1 )
+        {
+            SPLIT_ERROR( "Cannot read data from the input file: %s",
+                         SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+        } else if ( !res )
+        {
+            SPLIT_ERROR( "Read %ld bytes from the input file at offset %ld. %ld bytes "
+                         "were expected. Was the file truncated?", bytes_read, offset,
+                         size);
+        }
+
+        bytes_read += res;
+    }
+
+    return bytes_read;
+}
+
+/**
+ * Write chunk of data to output file
+ */
+int64_t split_WriteOutput( int fd, const char *buff, int64_t data_start, int64_t data_end)
+{
+    char err_msg[500];
+    int64_t io_size = data_end - data_start + 1;
+
+    if ( split_sink_state->sink )
+    {
+        split_WriteSink( fd, buff + data_start, io_size);
+
+        return io_size;
+    }
+
+    int64_t start = split_StartTimer();
+    int64_t bytes_written = write( fd, buff + data_start, io_size);
+
+    split_StopTimer( SPLIT_PHASE_WRITE, start, std::max( bytes_written, (int64_t)0));
+
+    if ( bytes_written == -1 )
+    {
+        SPLIT_ERROR( "Cannot write data to output file: %s",
+                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+    } else if ( bytes_written != io_size )
+    {
+        SPLIT_ERROR( "Written %ld bytes to an output file. %ld bytes were expected. "
+                     "Is it a regular storage device?", bytes_written, io_size);
+    }
+
+    return bytes_written;
+}
+
+/**
+ * Preallocate space for data of an output file
+ *
+ * A file growing by appends gets its space piece by piece, which fragments
+ * it and updates metadata of the file system on each append. Preallocated
+ * space is allocated at once. The size of the file is kept, so it grows with
+ * the data written as usual, and a piece left unfinished by an error (or a
+ * crash) is not padded with zeroes. It's only an optimization, so errors (for
+ * example, on file systems that don't support preallocation) are ignored
+ *
+ * Return value: "true" if the space was preallocated. Then the space beyond
+ *               the data should be released when the file is written (see
+ *               "split_TrimOutput()")
+ */
+static bool split_PreallocateOutput( int fd, int64_t size)
+{
+    return !split_sink_state->sink && (size > 0)
+           && !fallocate( fd, FALLOC_FL_KEEP_SIZE, 0, size);
+}
+
+/**
+ * Release preallocated space of an output file beyond the data written
+ */
+static void split_TrimOutput( int fd, int64_t size)
+{
+    char err_msg[500];
+
+    if ( ftruncate( fd, size) == -1 )
+    {
+        SPLIT_ERROR( "Cannot truncate output file: %s",
+                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+    }
+}
+
+/**
+ * Advise the kernel of the way the input file is accessed. It's only a hint,
+ * so errors (for example, on pipes) are ignored
+ */
+static void split_AdviseInput( int fd, int advice)
+{
+    posix_fadvise( fd, 0, 0, advice);
+}
+
+/**
+ * Switch file to direct I/O
+ */
+static void split_EnableDirectIo( int fd, const char *file_kind)
+{
+    char err_msg[500];
+    int flags = fcntl( fd, F_GETFL);
+
+    if ( (flags == -1) || (fcntl( fd, F_SETFL, flags | O_DIRECT) == -1) )
+    {
+        SPLIT_ERROR( "Cannot use direct I/O for %s file: %s", file_kind,
+                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+    }
+}
+
+/**
+ * Get alignment of file offsets, I/O sizes and memory buffers required for
+ * direct I/O on a file
+ */
+static int64_t split_GetDirectIoAlign( int fd)
+{
+    int64_t align = SPLIT_DIRECT_IO_ALIGN_DEFAULT;
+
+#ifdef STATX_DIOALIGN
+    struct statx stx;
+
+    if ( !statx( fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx)
+         && (stx.stx_mask & STATX_DIOALIGN) && stx.stx_dio_offset_align )
+    {
+        align = std::max( stx.stx_dio_offset_align, stx.stx_dio_mem_align);
+    }
+#endif
+
+    return align;
+}
+
+/**
+ * Allocate buffer suitable for direct I/O
+ */
+static char *split_AllocAlignedBuff( int64_t size, int64_t align)
+{
+    void *buff = NULL;
+
+    align = std::max( align, (int64_t)sysconf( _SC_PAGESIZE));
+
+    if ( posix_memalign( &buff, align, size) )
+    {
+        SPLIT_ERROR( "Couldn't allocate internal buffer of size %ld", size);
+    }
+
+    return (char *)buff;
+}
+
+/**
+ * Output file written with direct I/O
+ *
+ * Both data and size of each write must be aligned in this case. Data
+ * going to the output file is collected in an aligned staging buffer,
+ * and only whole blocks are written. The unaligned tail of the file is
+ * written padded to a whole block, and then the file is truncated to
+ * its real size
+ */
+typedef struct
+{
+    int fd;
+    /* Alignment required by the file */
+    int64_t align;
+    /* Staging buffer */
+    char *buff;
+    int64_t buff_size;
+    /* Amount of data in the staging buffer */
+    int64_t buff_data_size;
+    /* Amount of data written to the file */
+    int64_t file_size;
+} split_DirectOutput_t;
+
+/**
+ * Start writing output file with direct I/O. "buff" is a staging buffer
+ * allocated by "split_AllocAlignedBuff()"
+ */
+static void split_StartDirectOutput( split_DirectOutput_t *output,
+                                     int fd,
+                                     char *buff,
+                                     int64_t buff_size)
+{
+    split_EnableDirectIo( fd, "output");
+    output->fd = fd;
+    output->align = split_GetDirectIoAlign( fd);
+    output->buff = buff;
+    output->buff_size = buff_size;
+    output->buff_data_size = 0;
+    output->file_size = 0;
+
+    if ( (buff_size % output->align)
+         || ((int64_t)buff % output->align) )
+    {
+        SPLIT_ERROR( "Chunk size should be a multiple of %ld for direct I/O on "
+                     "output files", output->align);
+    }
+}
+
+/**
+ * Append data to output file written with direct I/O
+ */
+static void split_WriteDirectOutput( split_DirectOutput_t *output,
+                                     const char *data,
+                                     int64_t size)
+{
+    while ( size )
+    {
+        int64_t copy_size = std::min( size,
+                                      output->buff_size - output->buff_data_size);
+
+        memcpy( output->buff + output->buff_data_size, data, copy_size);
+        output->buff_data_size += copy_size;
+        data += copy_size;
+        size -= copy_size;
+
+        if ( output->buff_data_size == output->buff_size )
+        {
+            split_WriteOutput( output->fd, output->buff, 0, output->buff_size - 1);
+            output->file_size += output->buff_size;
+            output->buff_data_size = 0;
+        }
+    }
+}
+
+/**
+ * Write data remaining in the staging buffer and set real size of output
+ * file written with direct I/O
+ */
+static void split_FinishDirectOutput( split_DirectOutput_t *output)
+{
+    char err_msg[500];
+    int64_t tail_size = output->buff_data_size;
+
+    if ( !tail_size )
+    {
+        return;
+    }
+
+    int64_t aligned_size = (tail_size + output->align - 1) / output->align
+                           * output->align;
+
+    memset( output->buff + tail_size, 0, aligned_size - tail_size);
+    split_WriteOutput( output->fd, output->buff, 0, aligned_size - 1);
+    output->file_size += tail_size;
+    output->buff_data_size = 0;
+
+    if ( ftruncate( output->fd, output->file_size) == -1 )
+    {
+        SPLIT_ERROR( "Cannot truncate output file: %s",
+                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+    }
+}
+
+/**
+ * Output file compressed on the fly. Data is queued to a pool of compressing
+ * threads (see "deflate.cpp"), and compressed blocks are written in order as
+ * they become ready
+ */
+typedef struct
+{
+    int fd;
+    split_Deflater_t *deflater;
+    /* CRC32 and size of uncompressed data of the file */
+    uLong crc;
+    int64_t data_size;
+    /* Amount of data written to the file */
+    int64_t file_size;
+} split_CompressedOutput_t;
+
+/**
+ * Write compressed block to a compressed output file and free it
+ */
+static void split_WriteDeflatedBlock( split_CompressedOutput_t *output,
+                                      split_DeflatedBlock_t *block)
+{
+    split_WriteOutput( output->fd, block->compressed.data(), 0,
+                       block->compressed.size() - 1);
+    output->file_size += block->compressed.size();
+    output->crc = crc32_combine( output->crc, block->crc, block->data.size());
+    output->data_size += block->data.size();
+    delete block;
+}
+
+/**
+ * Start writing compressed output file
+ */
+static void split_StartCompressedOutput( split_CompressedOutput_t *output,
+                                         int fd,
+                                         split_Deflater_t *deflater)
+{
+    std::vector<char> header;
+
+    output->fd = fd;
+    output->deflater = deflater;
+    output->crc = crc32( 0, Z_NULL, 0);
+    output->data_size = 0;
+    output->file_size = 0;
+    split_GetDeflatedHeader( deflater->compression, header);
+
+    if ( !header.empty() )
+    {
+        split_WriteOutput( fd, header.data(), 0, header.size() - 1);
+        output->file_size += header.size();
+    }
+}
+
+/**
+ * Append data to compressed output file. Blocks compressed so far are written
+ */
+static void split_WriteCompressedOutput( split_CompressedOutput_t *output,
+                                         const char *data,
+                                         int64_t size)
+{
+    split_DeflatedBlock_t *block = NULL;
+
+    /* Keep the number of blocks in work bounded */
+    while ( !split_HasDeflaterRoom( output->deflater) )
+    {
+        split_WriteDeflatedBlock( output, split_TakeDeflated( output->deflater, true));
+    }
+
+    split_DeflateData( output->deflater, data, size);
+
+    while ( (block = split_TakeDeflated( output->deflater, false)) )
+    {
+        split_WriteDeflatedBlock( output, block);
+    }
+}
+
+/**
+ * Wait for all data appended to compressed output file to be compressed and
+ * written
+ */
+static void split_SyncCompressedOutput( split_CompressedOutput_t *output)
+{
+    split_DeflatedBlock_t *block = NULL;
+
+    while ( (block = split_TakeDeflated( output->deflater, true)) )
+    {
+        split_WriteDeflatedBlock( output, block);
+    }
+}
+
+/**
+ * Write remaining data and the trailer of compressed output file
+ */
+static void split_FinishCompressedOutput( split_CompressedOutput_t *output)
+{
+    std::vector<char> trailer;
+
+    split_SyncCompressedOutput( output);
+    split_GetDeflatedTrailer( output->deflater->compression, output->crc,
+                              output->data_size, trailer);
+    split_WriteOutput( output->fd, trailer.data(), 0, trailer.size() - 1);
+    output->file_size += trailer.size();
+}
+
+/**
+ * Calculate projected amount of input data still needed for a piece to reach
+ * compressed size "piece_size". "file_size" is the amount of compressed data
+ * written to the piece already. Compression ratio is estimated as
+ * "ratio_file_size / ratio_data_size". If it's unknown yet, the piece size is
+ * taken as uncompressed one
+ */
+static int64_t split_CalcCompressedPieceRest( int64_t piece_size,
+                                              int64_t file_size,
+                                              int64_t ratio_data_size,
+                                              int64_t ratio_file_size)
+{
+    if ( !ratio_data_size || !ratio_file_size )
+    {
+        return piece_size;
+    }
+
+    double ratio = (double)ratio_file_size / ratio_data_size;
+
+    /* At least one byte, so that the piece is cut at an element bound */
+    return std::max( (int64_t)1, (int64_t)((piece_size - file_size) / ratio));
+}
+
+/**
+ * Find bound of a fixed-size record. Arguments and return value are the same
+ * as the ones of bound finders, except that "buff" is replaced with the
+ * offset of the buffer inside the input file. The data itself is not needed:
+ * records end at offsets "header_size + k * record_size - 1" (k > 0) of the
+ * input file
+ */
+static int64_t split_FindRecordBound( int64_t buff_offset,
+                                      int64_t projected_bound,
+                                      int64_t buff_size,
+                                      bool is_first_block,
+                                      int64_t record_size,
+                                      int64_t header_size)
+{
+    SPLIT_ASSERT( projected_bound >= 0);
+    SPLIT_ASSERT( projected_bound < buff_size);
+
+    /* End of the first record */
+    int64_t first_end = header_size + record_size - 1;
+    int64_t projected_end = buff_offset + projected_bound;
+    /* Closest ends of records to the left and to the right of the projected
+       bound. The left one coincides with the projected bound if it's an end
+       of a record */
+    int64_t left_end = -1;
+    int64_t right_end = first_end;
+
+    if ( projected_end >= first_end )
+    {
+        left_end = projected_end - (projected_end - first_end) % record_size;
+        right_end = left_end + record_size;
+    }
+
+    /* Bounds relative to the buffer */
+    int64_t left = left_end - buff_offset;
+    int64_t right = right_end - buff_offset;
+    /* Returning "-1" is allowed only if the buffer doesn't start a new piece */
+    bool is_left_ok = (left_end != -1) && (left >= (is_first_block ? 0 : -1));
+    bool is_right_ok = right < buff_size;
+
+    /* Prefer the left bound on ties, like bound finders do */
+    if ( is_left_ok && (!is_right_ok || (projected_bound - left <= right - projected_bound)) )
+    {
+        return left;
+    } else if ( is_right_ok )
+    {
+        return right;
+    }
+
+    return SPLIT_BOUND_NOT_FOUND;
+}
+
+/**
+ * Determine upper bound of data-chunk that will be transferred from
+ * the double-buffer to output file
+ *
+ * "active_data" points to the first byte of active data (i.e. to the byte
+ * at offset "data_start" of the double-buffer). The data may also reside
+ * outside of the double-buffer (for example in a memory-mapped input file).
+ * "input_offset" is the offset of active data inside the input file. When
+ * records are of fixed size, "active_data" is not accessed
+ *
+ * Return value: offset of the last byte to transfer inside the double-buffer,
+ *               or SPLIT_BOUND_NOT_FOUND if no element bound was found in a
+ *               full chunk of data. The chunk is too small in the latter case
+ */
+int64_t split_CalcUpperBoundOfOutputTransfer( const split_Opts_t* const opts,
+                                              const char *active_data,
+                                              int64_t input_offset,
+                                              int64_t buff_size,
+                                              int64_t data_start,
+                                              int64_t data_end,
+                                              int64_t projected_max,
+                                              bool is_first_block,
+                                              bool is_end_of_input,
+                                              bool is_last_piece)
+{
+    /* Size of active data currently in the double-buffer */
+    int64_t active_data_size = data_end - data_start + 1;
+    int64_t bound = -1;
+
+    SPLIT_ASSERT( active_data_size < 2 * buff_size);
+
+    /* Check if we need more data than there is available in the buffer */
+    if ( projected_max > active_data_size )
+    {
+        /* Check if we have more than a full chunk */
+        if ( active_data_size >= buff_size )
+        {
+            return data_start + buff_size - 1;
+        } else
+        {
+            return data_end;
+        }
+    } else
+    {
+        /* Do not search for a closest element bound if we're writing the last
+           piece. We have no choice but to append all remaining buffer contents
+           to this file */
+        if ( is_last_piece )
+        {
+            SPLIT_ASSERT( projected_max == active_data_size);
+
+            return data_end;
+        }
+
+        /* Find element bound which is closest to projected file end */
+        int64_t start = split_StartTimer();
+
+        if ( opts->record_size )
+        {
+            bound = split_FindRecordBound( input_offset, projected_max - 1,
+                                           data_end - data_start + 1, is_first_block,
+                                           opts->record_size, opts->header_size);
+        } else
+        {
+            bound = opts->format->find_bound( active_data, projected_max - 1,
+                                              data_end - data_start + 1,
+                                              is_first_block);
+        }
+
+        split_StopTimer( SPLIT_PHASE_FIND_BOUND, start, 0);
+
+        if ( bound != SPLIT_BOUND_NOT_FOUND )
+        {
+            SPLIT_ASSERT( (bound >= -1) && (bound < data_end - data_start + 1));
+            SPLIT_ASSERT( (bound != -1) || !is_first_block);
+            split_RecordBound( projected_max - 1, bound);
+
+            return bound + data_start;
+        } else if ( is_end_of_input )
+        {
+            /* No more data remains in input file. Best we can do
+               is to append all active data to the current piece */
+            return data_end;
+        } else
+        {
+            SPLIT_ASSERT( active_data_size >= buff_size);
+
+            return SPLIT_BOUND_NOT_FOUND;
+        }
+    }
+
+    /* Shouldn't be here */
+    SPLIT_ASSERT( 0);
+
+    /* Return statement just to make compiler happy */
+    return -1;
+}
+
+/**
+ * Start reading the input through an inflater if the input file is
+ * compressed or if there are several input files (see "concat.cpp"). Return
+ * NULL if the input file is read directly
+ */
+static split_Inflater_t *split_StartInputInflater( const split_Opts_t* const opts,
+                                                   int fd,
+                                                   split_Inflater_t *inflater)
+{
+    if ( opts->input_paths.size() > 1 )
+    {
+        split_StartConcatenation( inflater, opts->input_paths, opts->num_threads);
+    } else if ( opts->compression )
+    {
+        split_StartInflater( inflater, fd, opts->compression, opts->num_threads);
+    } else
+    {
+        return NULL;
+    }
+
+    return inflater;
+}
+
+/**
+ * Weigh the whole input file (see "weigh.cpp"). "input_size" is the size of
+ * the input (after decompression). The file is left at zero offset
+ *
+ * If the input is bigger than "opts->balance_sample", the weight is
+ * estimated by weighing chunks evenly spread over the input. Each chunk is
+ * weighed from its first element bound
+ */
+static int64_t split_WeighInput( const split_Opts_t* const opts,
+                                 int fd,
+                                 int64_t input_size,
+                                 int64_t buff_size)
+{
+    char err_msg[500];
+    /* Data is read to the upper half of a double-buffer, as when splitting */
+    char *double_buff = (char *)malloc( 2 * buff_size);
+    char *buff = double_buff + buff_size;
+    split_Weigher_t weigher;
+    split_WeightMeasure_t measure = (opts->balance == SPLIT_BALANCE_RESIDUES)
+                                    ? SPLIT_WEIGHT_RESIDUES
+                                    : SPLIT_WEIGHT_RECORDS;
+    int64_t weight = 0, size_weighed = 0;
+
+    if ( !double_buff )
+    {
+        SPLIT_ERROR( "Couldn't allocate internal buffer of size %ld", 2 * buff_size);
+    }
+
+    split_OnError_t free_buffer( [&]()
+    {
+        free( double_buff);
+    });
+
+    split_StartWeigher( &weigher, opts->format->layout, measure);
+
+    if ( opts->balance_sample && (opts->balance_sample < input_size) )
+    {
+        int64_t num_samples = (opts->balance_sample + buff_size - 1) / buff_size;
+        int64_t sampled_size = 0;
+        double sampled_weight = 0;
+
+        for ( int64_t i = 0; i < num_samples; i++ )
+        {
+            int64_t size = std::min( buff_size, input_size);
+            int64_t offset = (num_samples > 1)
+                             ? (input_size - size) / (num_samples - 1) * i : 0;
+            int64_t start = 0;
+
+            split_ReadInputAt( fd, buff, size, offset);
+
+            if ( offset )
+            {
+                int64_t bound = opts->format->find_bound( buff, 0, size, false);
+
+                if ( bound == SPLIT_BOUND_NOT_FOUND )
+                {
+                    continue;
+                }
+
+                start = bound + 1;
+            }
+
+            split_StartWeigher( &weigher, opts->format->layout, measure);
+            sampled_weight += split_Weigh( &weigher, buff + start, size - start,
+                                           INT64_MAX, &size_weighed);
+            sampled_size += size - start;
+        }
+
+        if ( sampled_size )
+        {
+            weight = (int64_t)(sampled_weight * input_size / sampled_size);
+        }
+    } else
+    {
+        split_Inflater_t inflater;
+        split_Inflater_t *input_inflater = split_StartInputInflater( opts, fd,
+                                                                     &inflater);
+        int64_t bytes_read = 0;
+        split_OnError_t stop_inflater( [&]()
+        {
+            if ( input_inflater )
+            {
+                split_StopInflater( input_inflater);
+            }
+        });
+
+        while ( (bytes_read = split_FillUpperBuffHalfFromStream( fd, input_inflater,
+                                                                 double_buff,
+                                                                 buff_size)) )
+        {
+            weight += split_Weigh( &weigher, buff, bytes_read, INT64_MAX,
+                                   &size_weighed);
+        }
+
+        if ( input_inflater )
+        {
+            split_StopInflater( input_inflater);
+        }
+
+        if ( lseek( fd, 0, SEEK_SET) == -1 )
+        {
+            SPLIT_ERROR( "Cannot seek input file: %s",
+                         SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+        }
+    }
+
+    free( double_buff);
+
+    return weight;
+}
+
+/**
+ * Calculate chunk size grown to fit an element that doesn't fit into a chunk
+ * of "buff_size". "num_buffs" is the number of double-buffers of that size
+ * kept at once. Exit with an error if growth would exceed the memory limit
+ */
+static int64_t split_GrowChunkSize( const split_Opts_t* const opts,
+                                    int64_t buff_size,
+                                    int64_t num_buffs)
+{
+    if ( (buff_size > INT64_MAX / 4 / num_buffs)
+         || (4 * buff_size * num_buffs > opts->max_memory) )
+    {
+        SPLIT_ERROR( "No item bound found inside a data chunk of %ld bytes. The chunk "
+                     "can't grow further within the memory limit of %ld bytes (see "
+                     "\"--max-memory\")", buff_size, opts->max_memory);
+    }
+
+    return 2 * buff_size;
+}
+
+/**
+ * Replace the double-buffer with a double-buffer for a different chunk size
+ *
+ * "active_size" bytes of active data at "active_data" are moved to the end of
+ * the lower half of the new double-buffer. If "*mirror" is not NULL, the
+ * double-buffer resides inside that mirrored ring of "*mirror_size" bytes.
+ * The new double-buffer is put inside a new mirrored ring then (or into plain
+ * memory if the ring can't be created). "align" is alignment of the buffer
+ * required by direct I/O. It's "1" if direct I/O is not used
+ *
+ * Return value: the new double-buffer
+ */
+static char *split_ResizeDoubleBuff( char *double_buff,
+                                     const char *active_data,
+                                     int64_t active_size,
+                                     int64_t new_size,
+                                     char **mirror,
+                                     int64_t *mirror_size,
+                                     int64_t align)
+{
+    char *new_mirror = NULL;
+    int64_t new_mirror_size = 0;
+    char *new_buff = NULL;
+
+    if ( *mirror )
+    {
+        new_buff = new_mirror = split_AllocMirroredBuff( new_size, &new_mirror_size);
+    }
+
+    if ( new_buff )
+    {
+        /* The buffer is mirrored */
+    } else if ( align > 1 )
+    {
+        new_buff = split_AllocAlignedBuff( 2 * new_size, align);
+    } else if ( !(new_buff = (char *)malloc( 2 * new_size)) )
+    {
+        SPLIT_ERROR( "Couldn't allocate internal buffer of size %ld", 2 * new_size);
+    }
+
+    int64_t start = split_StartTimer();
+
+    memcpy( new_buff + new_size - active_size, active_data, active_size);
+    split_StopTimer( SPLIT_PHASE_MOVE, start, active_size);
+
+    if ( *mirror )
+    {
+        munmap( *mirror, 2 * *mirror_size);
+    } else
+    {
+        free( double_buff);
+    }
+
+    *mirror = new_mirror;
+    *mirror_size = new_mirror_size;
+
+    return new_buff;
+}
+
+/**
+ * Split source file into pieces
+ *
+ * This is a routine that does all significant work
+ *
+ * The algorithm reads and writes data in chunks of fixed size (except maybe
+ * last read of input file and last write of output file). The algorithm uses
+ * a buffer of double chunk size. The following rules apply to this buffer:
+ * 1) when data is being read from input file it first comes to this buffer.
+ *    Data contained in the buffer is called 'active data'
+ * 2) first chunk of data fetched from input file comes to the second half of
+ *    the buffer
+ * 3) then some piece of acitve data (starting from left bound of these data)
+ *    is moved to an output file
+ * 4) if after that some active data remains in the buffer, it is moved to
+ *    the first half of the buffer, so that right bound of the data conicides
+ *    with the right bound of the first half
+ * 5) the second half is filled from the input file. After that active data still
+ *    represents continuous piece of input data (because when moving data from
+ *    the second half to the first, we joined it to the beginning of the second
+ *    half)
+ * 6) steps 3)-5) are repeated, with addition that in step 4) the data is moved
+ *    from the second half to the first only when left bound of active data
+ *    becomes bigger (in terms of offset) than left bound of the second half
+ *
+ * By default the double-buffer is placed inside a mirrored ring. Then in step 4)
+ * data is not moved. Instead, the double-buffer is moved forward inside the
+ * ring, so that the data ends up in its first half
+ *
+ * When the pipeline engine is used, the double-buffer is replaced with a ring
+ * of double-buffers, which upper halves are filled ahead by a separate thread.
+ * Step 5) then means taking the next double-buffer from the ring, and step 4)
+ * moves active data to the lower half of that next double-buffer
+ *
+ * If "plan" is not NULL, the routine only plans the pieces and doesn't write
+ * anything. The same algorithm is executed, but the double-buffer is filled
+ * virtually: input data is brought to the buffer (by positioned reads) only
+ * when an element bound needs to be found. Bounds of all pieces are appended
+ * to "plan". They are exactly the same as the bounds of the pieces that would
+ * be written by this routine otherwise
+ *
+ * If "written" is not NULL, pieces written are appended to it
+ *
+ * If no element bound is found in a full chunk of data, the double-buffer is
+ * replaced with a double-buffer for a chunk of twice the size, and more data
+ * is read. When active data fits into a chunk of the original size again, the
+ * original double-buffer size is restored. The pipeline engine doesn't
+ * support that, because its reader thread fills buffers of fixed size
+ */
+int split_SplitSource( const split_Opts_t* const opts,
+                       std::vector<split_Piece_t> *plan,
+                       std::vector<split_ManifestPiece_t> *written)
+{
+    char err_msg[500];
+    int fd_input = -1;
+    /* Current chunk size, and the biggest one. The chunk grows to fit big
+       elements */
+    int64_t buff_size = opts->buffer_size;
+    int64_t peak_buff_size = buff_size;
+    /* Indicator that the input is read as a stream of unknown size */
+    bool is_stream = opts->piece_size || opts->records_per_piece;
+
+    /* Open input file */
+    if ( opts->input_path == "-" )
+    {
+        fd_input = STDIN_FILENO;
+    } else
+    {
+        fd_input = open( (opts->input_path).c_str(), O_RDONLY);
+    }
+
+    if ( fd_input == -1 )
+    {
+        SPLIT_ERROR( "Cannot open file \"%s\": %s", (opts->input_path).c_str(),
+                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+    }
+
+    /* Resources are released if the split fails */
+    split_OnError_t close_input( [&]()
+    {
+        close( fd_input);
+    });
+
+    /* The input is read as a stream from the starting offset. Offsets of
+       pieces are counted from it */
+    if ( opts->start_offset && (lseek( fd_input, opts->start_offset, SEEK_SET) == -1) )
+    {
+        SPLIT_ERROR( "Cannot seek input file: %s",
+                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+    }
+
+    /* Calculate number of digits needed to write down number of pieces.
+       We need this number because we are going to append ordinal numbers of
+       pieces to their names */
+    int num_digits = is_stream ? 1 : split_CalcNumWidth( opts->num_pieces);
+    /* Get size of input file. Size of a stream is unknown until its end is
+       reached. Size of a compressed file is the size of decompressed data.
+       Size of several input files is their total size */
+    int64_t input_size = INT64_MAX;
+
+    if ( !is_stream && (opts->input_paths.size() > 1) )
+    {
+        input_size = split_GetConcatenatedSize( opts->input_paths);
+    } else if ( !is_stream && opts->compression )
+    {
+        input_size = split_GetInflatedSize( fd_input, opts->compression);
+    } else if ( !is_stream )
+    {
+        input_size = split_GetInputSize( fd_input);
+    }
+
+    /* Pieces balanced by records or residues are cut by the weight of the data
+       instead of its size. Total weight is needed to balance a given number of
+       pieces */
+    bool is_weighed = opts->records_per_piece || (opts->balance == SPLIT_BALANCE_RECORDS)
+                      || (opts->balance == SPLIT_BALANCE_RESIDUES);
+    split_Weigher_t weigher;
+    int64_t total_weight = 0, weight_written = 0;
+
+    split_StartWeigher( &weigher, opts->format->layout,
+                        (opts->balance == SPLIT_BALANCE_RESIDUES) ? SPLIT_WEIGHT_RESIDUES
+                                                                  : SPLIT_WEIGHT_RECORDS);
+
+    if ( is_weighed && !is_stream )
+    {
+        total_weight = split_WeighInput( opts, fd_input, input_size, buff_size);
+    }
+
+    /* When planning, only small windows around projected bounds are read.
+       Read-ahead would waste I/O on data that is never used */
+    split_AdviseInput( fd_input, plan ? POSIX_FADV_RANDOM : POSIX_FADV_SEQUENTIAL);
+
+    /* Decompressor of a compressed input file, or reader of several input
+       files */
+    split_Inflater_t inflater;
+    split_Inflater_t *input_inflater = split_StartInputInflater( opts, fd_input,
+                                                                 &inflater);
+    split_OnError_t stop_inflater( [&]()
+    {
+        if ( input_inflater )
+        {
+            split_StopInflater( input_inflater);
+        }
+    });
+
+    if ( !plan && !is_stream )
+    {
+        split_SetProgressTotal( input_size);
+    }
+
+    int64_t bytes_available = input_size, bytes_not_read = input_size;
+    /* Alignment of input reads */
+    int64_t input_align = 1;
+    /* Output file written with direct I/O and its staging buffer */
+    split_DirectOutput_t direct_output = split_DirectOutput_t();
+    char *staging_buff = NULL;
+    /* Compressed output file, the pool of threads compressing it, and total
+       size of compressed pieces written */
+    split_CompressedOutput_t compressed_output = split_CompressedOutput_t();
+    split_Deflater_t deflater;
+    int64_t compressed_size = 0;
+
+    if ( opts->output_compression )
+    {
+        split_StartDeflater( &deflater, opts->output_compression,
+                             opts->compression_level, opts->num_threads);
+    }
+
+    split_OnError_t stop_deflater( [&]()
+    {
+        if ( opts->output_compression )
+        {
+            split_StopDeflater( &deflater);
+        }
+    });
+
+    if ( opts->is_direct )
+    {
+        split_EnableDirectIo( fd_input, "input");
+        input_align = split_GetDirectIoAlign( fd_input);
+
+        if ( buff_size % input_align )
+        {
+            SPLIT_ERROR( "Chunk size should be a multiple of %ld for direct I/O on "
+                         "the input file", input_align);
+        }
+
+        staging_buff = split_AllocAlignedBuff( buff_size, input_align);
+    }
+
+    /* Memory-mapped input file. Used only for planning */
+    const char *input_map = NULL;
+
+    if ( plan && (opts->engine == SPLIT_ENGINE_MMAP) && input_size
+         && !opts->record_size )
+    {
+        input_map = split_MapInput( fd_input, input_size);
+    }
+
+    /* Allocate double-buffer */
+    SPLIT_ASSERT( buff_size <= (INT64_MAX / 2));
+
+    char *double_buff = NULL;
+    /* Ring of double-buffers used by the pipeline engine */
+    split_Ring_t ring;
+    bool is_ring_used = !plan && (opts->engine == SPLIT_ENGINE_PIPELINE);
+    /* Indicator that upper half of the current double-buffer was filled
+       already (when active data was moved to the next buffer of the ring) */
+    bool is_upper_half_filled = false;
+    /* Mirrored ring holding the double-buffer, and its size */
+    char *mirror = NULL;
+    int64_t mirror_size = 0;
+    /* Amount of data moved between halves of the double-buffer */
+    int64_t bytes_moved = 0;
+    split_OnError_t free_buffers( [&]()
+    {
+        if ( is_ring_used )
+        {
+            split_StopRing( &ring);
+        } else if ( mirror )
+        {
+            munmap( mirror, 2 * mirror_size);
+        } else
+        {
+            free( double_buff);
+        }
+
+        if ( input_map )
+        {
+            munmap( (void *)input_map, input_size);
+        }
+
+        free( staging_buff);
+    });
+
+    if ( !plan && !is_ring_used && (opts->buffer_layout == SPLIT_BUFFER_MIRROR) )
+    {
+        mirror = split_AllocMirroredBuff( buff_size, &mirror_size);
+
+        if ( !mirror )
+        {
+            SPLIT_OUT( "Warning: couldn't create a mirrored ring (%s). Buffer of two "
+                       "halves will be used", SPLIT_STRERROR_R( err_msg,
+                                                               sizeof( err_msg)));
+        }
+    }
+
+    if ( is_ring_used )
+    {
+        split_StartRing( &ring, opts->ring_depth, fd_input, buff_size, input_size);
+    } else if ( mirror )
+    {
+        double_buff = mirror;
+    } else if ( opts->is_direct )
+    {
+        double_buff = split_AllocAlignedBuff( 2 * buff_size, input_align);
+    } else if ( !(double_buff = (char *)malloc( 2 * buff_size)) )
+    {
+        SPLIT_ERROR( "Couldn't allocate internal buffer of size %ld",
+                     2 * buff_size);
+    }
+
+    /* Initialize bounds of active data */
+    int64_t data_start = buff_size;
+    int64_t data_end = data_start - 1;
+
+    for ( int64_t piece_num = opts->first_piece;
+          is_stream || (piece_num < opts->num_pieces);
+          piece_num++ )
+    {
+        if ( is_stream )
+        {
+            /* Don't start a new piece if the stream has ended. If the
+               double-buffer is empty, read ahead to find that out */
+            if ( (data_start > data_end) && bytes_not_read )
+            {
+                int64_t bytes_read = split_FillUpperBuffHalfFromStream( fd_input,
+                                                                        input_inflater,
+                                                                        double_buff,
+                                                                        buff_size);
+
+                data_end += bytes_read;
+                bytes_not_read -= bytes_read;
+
+                if ( bytes_read < buff_size )
+                {
+                    split_EndStream( data_end - data_start + 1, &input_size,
+                                     &bytes_available, &bytes_not_read);
+                }
+            }
+
+            if ( !bytes_available )
+            {
+                break;
+            }
+        }
+
+        /* Calculate projected size of current piece */
+        int64_t to_read = opts->piece_size;
+
+        if ( opts->balance == SPLIT_BALANCE_COMPRESSED )
+        {
+            /* Use compression ratio of the pieces written so far */
+            to_read = split_CalcCompressedPieceRest( opts->piece_size, 0,
+                                                     input_size - bytes_available,
+                                                     compressed_size);
+        }
+
+        if ( !is_stream )
+        {
+            /* Divide remaining data equally between remaining pieces */
+            to_read = bytes_available / (opts->num_pieces - piece_num);
+
+            if ( bytes_available % (opts->num_pieces - piece_num) )
+            {
+                to_read++;
+            }
+        }
+
+        /* Weight of the piece. The projected size is then derived from the
+           weight of the data in the double-buffer */
+        int64_t piece_weight = opts->records_per_piece;
+        int64_t piece_weight_written = 0;
+
+        if ( is_weighed && !is_stream )
+        {
+            int64_t weight_left = std::max( total_weight - weight_written, (int64_t)1);
+
+            piece_weight = (weight_left + opts->num_pieces - piece_num - 1)
+                           / (opts->num_pieces - piece_num);
+        } else if ( is_weighed )
+        {
+            to_read = 1;
+        }
+
+        if ( !to_read )
+        {
+            SPLIT_ERROR( "Couldn't produce the requested number of pieces. "
+                         "Only %ld pieces were writted", piece_num);
+        }
+
+        /* Start new piece */
+        int output_fd = -1;
+        int is_first_block = true;
+        int64_t piece_offset = input_size - bytes_available;
+        bool is_preallocated = false;
+        split_OnError_t abandon_piece( [&]()
+        {
+            if ( output_fd != -1 )
+            {
+                split_AbandonPiece( output_fd);
+            }
+        });
+
+        if ( !plan )
+        {
+            output_fd = split_StartNewPiece( opts->output_dir, opts->output_file,
+                                             opts->output_extension,
+                                             num_digits, piece_num);
+
+            /* Size of compressed pieces is not known in advance. Weighed
+               pieces don't have a projected size in bytes */
+            if ( !opts->output_compression && !is_weighed )
+            {
+                is_preallocated = split_PreallocateOutput( output_fd,
+                                                           std::min( to_read,
+                                                                     bytes_available)
+                                                           + SPLIT_PREALLOC_SLACK);
+            }
+
+            if ( opts->is_direct )
+            {
+                split_StartDirectOutput( &direct_output, output_fd, staging_buff,
+                                         opts->buffer_size);
+            } else if ( opts->output_compression )
+            {
+                split_StartCompressedOutput( &compressed_output, output_fd,
+                                             &deflater);
+            }
+        }
+
+        while ( to_read )
+        {
+            SPLIT_ASSERT( data_end >= buff_size - 1);
+            SPLIT_ASSERT( data_start <= buff_size);
+
+            int64_t bytes_read = 0;
+
+            if ( data_end == buff_size - 1 )
+            {
+                if ( plan )
+                {
+                    /* Fill the upper half virtually */
+                    bytes_read = std::min( buff_size, bytes_not_read);
+                } else if ( is_upper_half_filled )
+                {
+                    bytes_read = std::min( buff_size, bytes_not_read);
+                    is_upper_half_filled = false;
+                } else if ( is_ring_used && bytes_not_read )
+                {
+                    /* Switch to the next double-buffer of the ring. The current
+                       one contains no active data */
+                    if ( double_buff )
+                    {
+                        split_ReleaseToRing( &ring);
+                    }
+
+                    double_buff = split_TakeFromRing( &ring, &bytes_read);
+                } else if ( is_stream )
+                {
+                    if ( bytes_not_read )
+                    {
+                        bytes_read = split_FillUpperBuffHalfFromStream( fd_input,
+                                                                        input_inflater,
+                                                                        double_buff,
+                                                                        buff_size);
+                    }
+                } else if ( input_inflater )
+                {
+                    bytes_read = split_FillUpperBuffHalfFromInflater( input_inflater,
+                                                                      double_buff,
+                                                                      buff_size,
+                                                                      bytes_not_read);
+                } else
+                {
+                    bytes_read = split_FillUpperBuffHalfFromInput( fd_input,
+                                                                   double_buff,
+                                                                   buff_size,
+                                                                   bytes_not_read,
+                                                                   input_align);
+                }
+
+                data_end += bytes_read;
+                bytes_not_read -= bytes_read;
+
+                if ( is_stream && bytes_not_read && (bytes_read < buff_size) )
+                {
+                    split_EndStream( data_end - data_start + 1, &input_size,
+                                     &bytes_available, &bytes_not_read);
+                }
+            }
+
+            /* Calculate upper bound of data that will be written to output file */
+            int64_t output_chunk_end = -1;
+            /* The last piece of a stream is not known in advance */
+            bool is_last_piece = !is_stream && (piece_num == opts->num_pieces - 1);
+            const char *active_data = double_buff + data_start;
+
+            if ( is_weighed && !is_last_piece )
+            {
+                /* Project the bound right before the data that would make
+                   the piece heavier than its weight */
+                split_Weigher_t probe = weigher;
+                int64_t active_data_size = data_end - data_start + 1;
+                int64_t size_weighed = 0;
+
+                split_Weigh( &probe, active_data, active_data_size,
+                             piece_weight - piece_weight_written, &size_weighed);
+                to_read = (size_weighed < active_data_size) ? size_weighed
+                                                            : active_data_size + 1;
+
+                if ( !to_read && (probe.measure == SPLIT_WEIGHT_RECORDS)
+                     && !is_first_block )
+                {
+                    /* The next record starts right at the beginning of the
+                       active data. The piece is complete */
+                    break;
+                } else if ( !to_read )
+                {
+                    to_read = 1;
+                }
+            }
+
+            if ( input_map )
+            {
+                active_data = input_map + input_size - bytes_available;
+            } else if ( plan && !is_last_piece && !opts->record_size
+                        && (to_read <= data_end - data_start + 1) )
+            {
+                /* When planning, bring active data to the buffer only if an
+                   element bound is going to be searched inside it. Bounds of
+                   fixed-size records don't need the data at all */
+                split_ReadInputAt( fd_input, double_buff + data_start,
+                                   data_end - data_start + 1,
+                                   input_size - bytes_available);
+            }
+
+            /* An element bound is searched if the piece may end inside the
+               active data */
+            bool is_bound_searched = to_read <= data_end - data_start + 1;
+
+            output_chunk_end = split_CalcUpperBoundOfOutputTransfer( opts,
+                                                                     active_data,
+                                                                     input_size
+                                                                     - bytes_available,
+                                                                     buff_size,
+                                                                     data_start,
+                                                                     data_end,
+                                                                     to_read,
+                                                                     is_first_block,
+                                                                     !bytes_not_read,
+                                                                     is_last_piece);
+
+            if ( output_chunk_end == SPLIT_BOUND_NOT_FOUND )
+            {
+                /* An element doesn't fit into the chunk. Grow the chunk and
+                   read more data */
+                if ( is_ring_used )
+                {
+                    SPLIT_ERROR( "No item bound found inside a data chunk. Buffer size "
+                                 "should be bigger than size of any item (chunks can't "
+                                 "grow with the pipeline engine)");
+                }
+
+                int64_t new_size = split_GrowChunkSize( opts, buff_size, 1);
+                int64_t active_data_size = data_end - data_start + 1;
+
+                /* Active data is not kept in the buffer when planning */
+                double_buff = split_ResizeDoubleBuff( double_buff, double_buff + data_start,
+                                                      plan ? 0 : active_data_size,
+                                                      new_size, &mirror, &mirror_size,
+                                                      input_align);
+                buff_size = new_size;
+                peak_buff_size = std::max( peak_buff_size, buff_size);
+                data_start = buff_size - active_data_size;
+                data_end = buff_size - 1;
+
+                continue;
+            }
+
+            /* A bound found inside the active data ends the piece, even if it
+               lies to the left of the projected bound. Otherwise the remainder
+               of the piece would run to the next bound to the right, because
+               bound finders of line-oriented formats never return "-1" */
+            if ( is_bound_searched )
+            {
+                SPLIT_ASSERT( output_chunk_end >= data_start - 1);
+                to_read = 0;
+            } else if ( (output_chunk_end < data_start) && !bytes_not_read )
+            {
+                /* No data is left. The piece is complete */
+                SPLIT_ASSERT( output_chunk_end == data_start - 1);
+                to_read = 0;
+            } else
+            {
+                SPLIT_ASSERT( output_chunk_end >= data_start);
+                to_read -= output_chunk_end - data_start + 1;
+            }
+
+            /* Append the chunk to the current output piece */
+            if ( opts->is_direct )
+            {
+                split_WriteDirectOutput( &direct_output, double_buff + data_start,
+                                         output_chunk_end - data_start + 1);
+            } else if ( opts->output_compression )
+            {
+                split_WriteCompressedOutput( &compressed_output,
+                                             double_buff + data_start,
+                                             output_chunk_end - data_start + 1);
+            } else if ( !plan )
+            {
+                split_WriteOutput( output_fd, double_buff, data_start,
+                                   output_chunk_end);
+            }
+
+            bytes_available -= output_chunk_end - data_start + 1;
+
+            if ( !plan )
+            {
+                split_AddProgress( output_chunk_end - data_start + 1);
+            }
+
+            if ( is_weighed )
+            {
+                int64_t size_weighed = 0;
+                int64_t chunk_weight = split_Weigh( &weigher, double_buff + data_start,
+                                                    output_chunk_end - data_start + 1,
+                                                    INT64_MAX, &size_weighed);
+
+                piece_weight_written += chunk_weight;
+                weight_written += chunk_weight;
+            }
+
+            /* Correct projected size of the piece by its own compression ratio.
+               Compressed size is known only when compression catches up */
+            if ( to_read && (opts->balance == SPLIT_BALANCE_COMPRESSED) )
+            {
+                split_SyncCompressedOutput( &compressed_output);
+                to_read = split_CalcCompressedPieceRest( opts->piece_size,
+                                                         compressed_output.file_size,
+                                                         input_size - bytes_available
+                                                         - piece_offset,
+                                                         compressed_output.file_size);
+            }
+
+            /* Shift left bound of active data */
+            SPLIT_ASSERT( output_chunk_end < INT64_MAX);
+            data_start = output_chunk_end + 1;
+            is_first_block = false;
+
+            /* Move data from upper half of the double-buffer to lower half */
+            if ( (data_start >= buff_size) && (data_end - data_start >= 0) )
+            {
+                int64_t active_data_size = data_end - data_start + 1;
+
+                if ( (buff_size > opts->buffer_size)
+                     && (active_data_size <= opts->buffer_size) )
+                {
+                    /* The big element is written. Restore the original chunk
+                       size */
+                    double_buff = split_ResizeDoubleBuff( double_buff,
+                                                          double_buff + data_start,
+                                                          plan ? 0 : active_data_size,
+                                                          opts->buffer_size, &mirror,
+                                                          &mirror_size, input_align);
+                    buff_size = opts->buffer_size;
+                } else if ( is_ring_used && bytes_not_read )
+                {
+                    /* Move active data to lower half of the next double-buffer
+                       of the ring, which upper half was filled ahead */
+                    int64_t bytes_read = 0;
+                    char *next_buff = split_TakeFromRing( &ring, &bytes_read);
+
+                    SPLIT_ASSERT( bytes_read == std::min( buff_size, bytes_not_read));
+
+                    int64_t start = split_StartTimer();
+
+                    memcpy( next_buff + buff_size - active_data_size,
+                            double_buff + data_start, active_data_size);
+                    split_StopTimer( SPLIT_PHASE_MOVE, start, active_data_size);
+                    split_ReleaseToRing( &ring);
+                    double_buff = next_buff;
+                    is_upper_half_filled = true;
+                    bytes_moved += active_data_size;
+                } else if ( mirror )
+                {
+                    /* Move the double-buffer forward instead of moving data */
+                    double_buff += data_end + 1 - buff_size;
+
+                    if ( double_buff >= mirror + mirror_size )
+                    {
+                        double_buff -= mirror_size;
+                    }
+                } else if ( !plan )
+                {
+                    /* Active data is not kept in the buffer when planning */
+                    int64_t start = split_StartTimer();
+
+                    memcpy( double_buff + buff_size - active_data_size,
+                            double_buff + data_start, active_data_size);
+                    split_StopTimer( SPLIT_PHASE_MOVE, start, active_data_size);
+                    bytes_moved += active_data_size;
+                }
+
+                data_start = buff_size - active_data_size;
+                data_end = buff_size - 1;
+            }
+
+            /* No data remains in the double-buffer. Need to reinitialize bounds
+               of active data */
+            if ( data_start > data_end )
+            {
+                SPLIT_ASSERT( (data_start == buff_size * 2)
+                              || (!bytes_available && !bytes_not_read));
+                SPLIT_ASSERT( data_end == data_start - 1);
+
+                if ( buff_size > opts->buffer_size )
+                {
+                    double_buff = split_ResizeDoubleBuff( double_buff, NULL, 0,
+                                                          opts->buffer_size, &mirror,
+                                                          &mirror_size, input_align);
+                    buff_size = opts->buffer_size;
+                }
+
+                data_start = buff_size;
+                data_end = data_start - 1;
+            }
+        }
+
+        if ( plan )
+        {
+            split_Piece_t piece = {piece_offset,
+                                   input_size - bytes_available - piece_offset};
+
+            plan->push_back( piece);
+        } else
+        {
+            if ( opts->is_direct )
+            {
+                split_FinishDirectOutput( &direct_output);
+            } else if ( opts->output_compression )
+            {
+                split_FinishCompressedOutput( &compressed_output);
+                compressed_size += compressed_output.file_size;
+            }
+
+            if ( is_preallocated )
+            {
+                split_TrimOutput( output_fd, opts->is_direct ? direct_output.file_size
+                                                             : lseek( output_fd, 0,
+                                                                      SEEK_CUR));
+            }
+
+            if ( written )
+            {
+                split_ManifestPiece_t piece = {opts->start_offset + piece_offset,
+                                               input_size - bytes_available
+                                               - piece_offset,
+                                               opts->records_per_piece
+                                               ? piece_weight_written : -1};
+
+                written->push_back( piece);
+            }
+
+            split_FinalizePiece( output_fd, piece_num);
+        }
+    }
+
+    SPLIT_ASSERT( bytes_available == 0);
+
+    if ( input_map )
+    {
+        munmap( (void *)input_map, input_size);
+    }
+
+    if ( peak_buff_size > opts->buffer_size )
+    {
+        SPLIT_OUT( "Chunk size was increased up to %ld bytes to fit big elements",
+                   peak_buff_size);
+    }
+
+    split_RecordBuffers( (is_ring_used ? opts->ring_depth : 1) * 2 * peak_buff_size);
+
+#ifdef SPLIT_DEBUG
+    if ( !plan )
+    {
+        SPLIT_OUT( "Bytes moved between halves of the double-buffer: %ld (%.4f per "
+                   "byte of output)", bytes_moved,
+                   input_size ? (double)bytes_moved / input_size : 0);
+    }
+#endif
+
+    if ( is_ring_used )
+    {
+        if ( double_buff )
+        {
+            split_ReleaseToRing( &ring);
+        }
+
+        split_StopRing( &ring);
+    } else if ( mirror )
+    {
+        munmap( mirror, 2 * mirror_size);
+    } else
+    {
+        free( double_buff);
+    }
+
+    if ( input_inflater )
+    {
+        split_StopInflater( input_inflater);
+    }
+
+    if ( opts->output_compression )
+    {
+        split_StopDeflater( &deflater);
+    }
+
+    free( staging_buff);
+    close( fd_input);
+
+    return 0;
+}
+
+/**
+ * Write memory ranges to an output file by gathering writes
+ */
+static void split_WriteGathered( int fd, std::vector<struct iovec> & ranges)
+{
+    char err_msg[500];
+    struct iovec *iov = ranges.data();
+    int64_t num_ranges = ranges.size();
+
+    if ( split_sink_state->sink )
+    {
+        for ( int64_t i = 0; i < num_ranges; i++ )
+        {
+            split_WriteSink( fd, (const char *)iov[i].iov_base, iov[i].iov_len);
+        }
+
+        return;
+    }
+
+    while ( num_ranges )
+    {
+        int64_t start = split_StartTimer();
+        ssize_t res = writev( fd, iov, std::min( num_ranges, (int64_t)IOV_MAX));
+
+        split_StopTimer( SPLIT_PHASE_WRITE, start, std::max( res, (ssize_t)0));
+
+        if ( res == -1 )
+        {
+            if ( errno == EINTR )
+            {
+                continue;
+            }
+
+            SPLIT_ERROR( "Cannot write data to output file: %s",
+                         SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+        }
+
+        /* Skip the ranges written. A partially written range is advanced, so
+           the ranges are modified */
+        while ( num_ranges && ((size_t)res >= iov->iov_len) )
+        {
+            res -= iov->iov_len;
+            iov++;
+            num_ranges--;
+        }
+
+        if ( res )
+        {
+            iov->iov_base = (char *)iov->iov_base + res;
+            iov->iov_len -= res;
+        }
+    }
+}
+
+/**
+ * Deal records of the source file to output files (see "distribute.cpp")
+ *
+ * The input is read in chunks to upper halves of double-buffers, as when
+ * splitting. Each chunk is cut at the last element bound found in it, and the
+ * unfinished record is moved to the lower half of the next double-buffer.
+ * Chunks are dealt by a pool of threads, while this routine reads next chunks
+ * and writes dealt ones in the order of the input
+ *
+ * If no element bound is found in a chunk, the chunk size is doubled and the
+ * whole chunk is carried over to the next one. Double-buffers are reallocated
+ * for the current chunk size when they are taken to be filled
+ */
+int split_DistributeSource( const split_Opts_t* const opts)
+{
+    char err_msg[500];
+    int fd_input = -1;
+    /* Current chunk size, and the biggest one. The chunk grows to fit big
+       elements */
+    int64_t buff_size = opts->buffer_size;
+    int64_t peak_buff_size = buff_size;
+    /* Memory taken by all double-buffers */
+    int64_t buffers_size = 0;
+    int64_t num_outputs = opts->num_pieces;
+
+    if ( opts->input_path == "-" )
+    {
+        fd_input = STDIN_FILENO;
+    } else
+    {
+        fd_input = open( (opts->input_path).c_str(), O_RDONLY);
+    }
+
+    if ( fd_input == -1 )
+    {
+        SPLIT_ERROR( "Cannot open file \"%s\": %s", (opts->input_path).c_str(),
+                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+    }
+
+    /* Resources are released if the split fails */
+    split_OnError_t close_input( [&]()
+    {
+        close( fd_input);
+    });
+
+    split_AdviseInput( fd_input, POSIX_FADV_SEQUENTIAL);
+
+    /* Size of a single regular uncompressed input file is known in advance */
+    struct stat input_stat;
+
+    if ( !opts->compression && (opts->input_paths.size() == 1)
+         && !fstat( fd_input, &input_stat)
+         && S_ISREG( input_stat.st_mode) )
+    {
+        split_SetProgressTotal( input_stat.st_size);
+    }
+
+    /* All output files are written at once */
+    int num_digits = split_CalcNumWidth( num_outputs);
+    std::vector<int> fds_output( num_outputs, -1);
+    split_OnError_t abandon_pieces( [&]()
+    {
+        for ( int64_t i = 0; i < num_outputs; i++ )
+        {
+            if ( fds_output[i] != -1 )
+            {
+                split_AbandonPiece( fds_output[i]);
+            }
+        }
+    });
+
+    for ( int64_t i = 0; i < num_outputs; i++ )
+    {
+        fds_output[i] = split_StartNewPiece( opts->output_dir, opts->output_file,
+                                             opts->output_extension, num_digits, i);
+    }
+
+    split_Inflater_t inflater;
+    split_Inflater_t *input_inflater = split_StartInputInflater( opts, fd_input,
+                                                                 &inflater);
+    split_Dealer_t dealer;
+
+    split_StartDealer( &dealer, opts->distribution, opts->format->layout, num_outputs,
+                       opts->num_threads);
+
+    /* Chunks which double-buffers are free to be filled */
+    std::vector<split_DealtChunk_t *> free_chunks;
+    std::vector<split_DealtChunk_t *> all_chunks;
+    /* Chunks are freed when threads using them are stopped */
+    split_OnError_t free_chunks_on_error( [&]()
+    {
+        split_StopDealer( &dealer);
+
+        if ( input_inflater )
+        {
+            split_StopInflater( input_inflater);
+        }
+
+        for ( size_t i = 0; i < all_chunks.size(); i++ )
+        {
+            free( all_chunks[i]->double_buff);
+            delete all_chunks[i];
+        }
+    });
+    /* Unfinished record left at the end of the last chunk read */
+    const char *tail = NULL;
+    int64_t tail_size = 0;
+    /* Output file receiving the first record of the next chunk written in
+       round-robin mode */
+    int64_t first_output = 0;
+    bool is_input_end = false;
+
+    while ( 1 )
+    {
+        /* Read ahead while there is room in the queue of chunks */
+        while ( !is_input_end && split_HasDealerRoom( &dealer) )
+        {
+            split_DealtChunk_t *chunk = NULL;
+
+            if ( !free_chunks.empty() )
+            {
+                chunk = free_chunks.back();
+                free_chunks.pop_back();
+            } else
+            {
+                chunk = new split_DealtChunk_t();
+                chunk->double_buff = NULL;
+                chunk->capacity = 0;
+                all_chunks.push_back( chunk);
+            }
+
+            int64_t start = split_StartTimer();
+
+            if ( chunk->capacity != buff_size )
+            {
+                /* The tail may reside in the old double-buffer of the chunk. So
+                   it's copied before the old double-buffer is freed */
+                char *double_buff = (char *)malloc( 2 * buff_size);
+
+                if ( !double_buff )
+                {
+                    SPLIT_ERROR( "Couldn't allocate internal buffer of size %ld",
+                                 2 * buff_size);
+                }
+
+                memcpy( double_buff + buff_size - tail_size, tail, tail_size);
+                free( chunk->double_buff);
+                buffers_size += 2 * (buff_size - chunk->capacity);
+                split_RecordBuffers( buffers_size);
+                chunk->double_buff = double_buff;
+                chunk->capacity = buff_size;
+                tail = double_buff + buff_size - tail_size;
+            }
+
+            /* The tail may reside in the upper half of the same double-buffer
+               if the chunk holding it was already written */
+            chunk->data = chunk->double_buff + buff_size - tail_size;
+            memmove( chunk->data, tail, tail_size);
+            split_StopTimer( SPLIT_PHASE_MOVE, start, tail_size);
+
+            int64_t bytes_read = split_FillUpperBuffHalfFromStream( fd_input,
+                                                                    input_inflater,
+                                                                    chunk->double_buff,
+                                                                    buff_size);
+            int64_t data_size = tail_size + bytes_read;
+
+            chunk->size = data_size;
+            tail_size = 0;
+
+            if ( bytes_read < buff_size )
+            {
+                is_input_end = true;
+            } else
+            {
+                start = split_StartTimer();
+
+                int64_t bound = opts->format->find_bound( chunk->data, data_size - 1,
+                                                          data_size, true);
+
+                split_StopTimer( SPLIT_PHASE_FIND_BOUND, start, 0);
+
+                /* An element doesn't fit into the chunk if no bound is found,
+                   or if the unfinished record doesn't fit into the lower half
+                   of a double-buffer. The chunk size is doubled then. A chunk
+                   without a bound is carried over to the next one as a whole */
+                chunk->size = (bound == SPLIT_BOUND_NOT_FOUND) ? 0 : bound + 1;
+                tail = chunk->data + chunk->size;
+                tail_size = data_size - chunk->size;
+
+                if ( tail_size > buff_size )
+                {
+                    buff_size = split_GrowChunkSize( opts, buff_size,
+                                                     dealer.max_chunks + 1);
+                    peak_buff_size = std::max( peak_buff_size, buff_size);
+                } else if ( tail_size <= opts->buffer_size )
+                {
+                    /* Restore the original chunk size */
+                    buff_size = opts->buffer_size;
+                }
+            }
+
+            if ( chunk->size )
+            {
+                split_DealData( &dealer, chunk);
+            } else
+            {
+                free_chunks.push_back( chunk);
+            }
+        }
+
+        split_DealtChunk_t *chunk = split_TakeDealt( &dealer);
+
+        if ( !chunk )
+        {
+            break;
+        }
+
+        for ( int64_t i = 0; i < num_outputs; i++ )
+        {
+            /* In round-robin mode the lists are numbered by records of the
+               chunk, and the first list goes to "first_output" */
+            int64_t list_num = (opts->distribution == SPLIT_DISTRIBUTE_ROUND_ROBIN)
+                               ? (i - first_output + num_outputs) % num_outputs
+                               : i;
+
+            split_WriteGathered( fds_output[i], chunk->lists[list_num]);
+        }
+
+        first_output = (first_output + chunk->num_records) % num_outputs;
+        split_AddProgress( chunk->size);
+        free_chunks.push_back( chunk);
+    }
+
+    split_StopDealer( &dealer);
+
+    if ( input_inflater )
+    {
+        split_StopInflater( input_inflater);
+    }
+
+    for ( int64_t i = 0; i < num_outputs; i++ )
+    {
+        split_FinalizePiece( fds_output[i], i);
+        fds_output[i] = -1;
+    }
+
+    for ( size_t i = 0; i < all_chunks.size(); i++ )
+    {
+        free( all_chunks[i]->double_buff);
+        delete all_chunks[i];
+    }
+
+    if ( peak_buff_size > opts->buffer_size )
+    {
+        SPLIT_OUT( "Chunk size was increased up to %ld bytes to fit big elements",
+                   peak_buff_size);
+    }
+
+    close( fd_input);
+
+    return 0;
+}
+
+/**
+ * Zero-copy methods of a split
+ */
+typedef struct
+{
+    /* Set when "copy_file_range()" is found to be unsupported for the input
+       and output files. All threads of the split then stop trying it */
+    std::atomic<bool> is_copy_file_range_broken;
+    /* The same for "splice()" */
+    std::atomic<bool> is_splice_broken;
+} split_ZeroCopy_t;
+
+static thread_local split_ZeroCopy_t *split_zero_copy = NULL;
+
+/**
+ * Check if error code returned by a zero-copy system call means that the call
+ * is not supported for the given files (as opposed to a real I/O error)
+ */
+static bool split_IsUnsupportedCopy( int err_no)
+{
+    return (err_no == EXDEV) || (err_no == EOPNOTSUPP) || (err_no == ENOSYS)
+           || (err_no == EINVAL);
+}
+
+/**
+ * Copy data from the input file to current offset of output file using
+ * "copy_file_range()"
+ *
+ * Return value: number of bytes copied. It's less than "size" only if the
+ *               system call is not supported for the given files
+ */
+static int64_t split_CopyFileRange( int fd_input,
+                                    int fd_output,
+                                    int64_t offset,
+                                    int64_t size)
+{
+    char err_msg[500];
+    int64_t copied = 0;
+
+    while ( (copied < size) && !split_zero_copy->is_copy_file_range_broken )
+    {
+        loff_t off_in = offset + copied;
+        int64_t start = split_StartTimer();
+        ssize_t res = copy_file_range( fd_input, &off_in, fd_output, NULL,
+                                       size - copied, 0);
+
+        split_StopTimer( SPLIT_PHASE_COPY, start, std::max( res, (ssize_t)0));
+
+        if ( res == -1 )
+        {
+            if ( !split_IsUnsupportedCopy( errno) )
+            {
+                SPLIT_ERROR( "Cannot copy data to output file: %s",
+                             SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+            }
+
+            if ( !split_zero_copy->is_copy_file_range_broken.exchange( true) )
+            {
+                SPLIT_OUT( "Warning: \"copy_file_range()\" is not supported (%s). "
+                           "Falling back to \"splice()\"",
+                           SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+            }
+        } else if ( !res )
+        {
+            SPLIT_ERROR( "Copied %ld bytes from the input file at offset %ld. %ld "
+                         "bytes were expected. Was the file truncated?", copied,
+                         offset, size);
+        } else
+        {
+            copied += res;
+            split_AddProgress( res);
+        }
+    }
+
+    return copied;
+}
+
+/**
+ * Copy data from the input file to current offset of output file using
+ * "splice()" through a pipe
+ *
+ * Return value: number of bytes copied. It's less than "size" only if the
+ *               system call is not supported for the given files
+ */
+static int64_t split_Splice( int fd_input, int fd_output, int64_t offset, int64_t size)
+{
+    char err_msg[500];
+    int64_t copied = 0;
+    int pipe_fds[2];
+
+    if ( split_zero_copy->is_splice_broken )
+    {
+        return 0;
+    }
+
+    if ( pipe( pipe_fds) == -1 )
+    {
+        SPLIT_ERROR( "Cannot create a pipe: %s",
+                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+    }
+
+    /* Pipe capacity limits amount of data moved by one call. Try to make the
+       pipe bigger. It's ok if it doesn't work */
+    int64_t pipe_size = fcntl( pipe_fds[1], F_SETPIPE_SZ, 1024 * 1024);
+
+    if ( pipe_size == -1 )
+    {
+        pipe_size = fcntl( pipe_fds[1], F_GETPIPE_SZ);
+    }
+
+    while ( (copied < size) && !split_zero_copy->is_splice_broken )
+    {
+        loff_t off_in = offset + copied;
+        int64_t start = split_StartTimer();
+        ssize_t in_pipe = splice( fd_input, &off_in, pipe_fds[1], NULL,
+                                  std::min( size - copied, pipe_size),
+                                  SPLICE_F_MOVE);
+
+        if ( in_pipe == -1 )
+        {
+            if ( !split_IsUnsupportedCopy( errno) )
+            {
+                SPLIT_ERROR( "Cannot read data from the input file: %s",
+                             SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+            }
+
+            if ( !split_zero_copy->is_splice_broken.exchange( true) )
+            {
+                SPLIT_OUT( "Warning: \"splice()\" is not supported (%s). Falling "
+                           "back to buffered copying",
+                           SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+            }
+
+            break;
+        } else if ( !in_pipe )
+        {
+            SPLIT_ERROR( "Copied %ld bytes from the input file at offset %ld. %ld "
+                         "bytes were expected. Was the file truncated?", copied,
+                         offset, size);
+        }
+
+        /* Data that got to the pipe must be drained to the output file. There is
+           no way back, so any error is fatal here */
+        int64_t moved = in_pipe;
+
+        while ( in_pipe )
+        {
+            ssize_t res = splice( pipe_fds[0], NULL, fd_output, NULL, in_pipe,
+                                  SPLICE_F_MOVE);
+
+            if ( res <= 0 )
+            {
+                SPLIT_ERROR( "Cannot write data to output file: %s",
+                             res ? SPLIT_STRERROR_R( err_msg, sizeof( err_msg))
+                                 : "no progress");
+            }
+
+            in_pipe -= res;
+            copied += res;
+            split_AddProgress( res);
+        }
+
+        split_StopTimer( SPLIT_PHASE_COPY, start, moved);
+    }
+
+    close( pipe_fds[0]);
+    close( pipe_fds[1]);
+
+    return copied;
+}
+
+/**
+ * Write data to current offset of output file directly from the memory-mapped
+ * input file
+ *
+ * Pages ahead of the cursor are advised for sequential access, so that the
+ * kernel reads them ahead aggressively. Pages left behind the cursor are
+ * released right after they are written. That keeps resident set of the
+ * process bounded even if the input file is bigger than RAM
+ */
+static int64_t split_WriteFromMap( int fd_output,
+                                   const char *input_map,
+                                   int64_t chunk_size,
+                                   int64_t offset,
+                                   int64_t size)
+{
+    int64_t page_size = sysconf( _SC_PAGESIZE);
+    /* Left bound of the mapping region that still wasn't released. Must be
+       aligned to a page bound */
+    int64_t released = offset - offset % page_size;
+
+    madvise( (void *)(input_map + released), offset + size - released,
+             MADV_SEQUENTIAL);
+
+    for ( int64_t copied = 0; copied < size; )
+    {
+        int64_t io_size = std::min( chunk_size, size - copied);
+
+        split_WriteOutput( fd_output, input_map, offset + copied,
+                           offset + copied + io_size - 1);
+        copied += io_size;
+        split_AddProgress( io_size);
+
+        int64_t release_end = offset + copied - (offset + copied) % page_size;
+
+        if ( release_end > released )
+        {
+            madvise( (void *)(input_map + released), release_end - released,
+                     MADV_DONTNEED);
+            released = release_end;
+        }
+    }
+
+    return size;
+}
+
+/**
+ * Copy one planned piece from the input file to a new output file
+ *
+ * "input_map" is the memory-mapped input file if the memory-mapping engine
+ * is used, and NULL otherwise
+ */
+static int split_CopyPiece( const split_Opts_t* const opts,
+                            int fd_input,
+                            const char *input_map,
+                            char *buff,
+                            int num_digits,
+                            int64_t piece_num,
+                            const split_Piece_t & piece)
+{
+    int output_fd = split_StartNewPiece( opts->output_dir, opts->output_file,
+                                         opts->output_extension, num_digits,
+                                         piece_num);
+    int64_t copied = 0;
+    split_OnError_t abandon_piece( [&]()
+    {
+        split_AbandonPiece( output_fd);
+    });
+
+    /* Size of the piece is exact. No need to trim the file */
+    split_PreallocateOutput( output_fd, piece.size);
+
+    /* Zero-copy methods are tried first. Whatever they fail to copy is copied
+       through the buffer */
+    if ( opts->engine == SPLIT_ENGINE_COPY )
+    {
+        copied += split_CopyFileRange( fd_input, output_fd, piece.offset,
+                                       piece.size);
+        copied += split_Splice( fd_input, output_fd, piece.offset + copied,
+                                piece.size - copied);
+    } else if ( input_map )
+    {
+        copied += split_WriteFromMap( output_fd, input_map, opts->buffer_size,
+                                      piece.offset, piece.size);
+    }
+
+    while ( copied < piece.size )
+    {
+        int64_t io_size = std::min( opts->buffer_size, piece.size - copied);
+
+        split_ReadInputAt( fd_input, buff, io_size, piece.offset + copied);
+        split_WriteOutput( output_fd, buff, 0, io_size - 1);
+        copied += io_size;
+        split_AddProgress( io_size);
+    }
+
+    split_FinalizePiece( output_fd, piece_num);
+
+    return 0;
+}
+
+/**
+ * Copy planned pieces to output files using a pool of threads
+ *
+ * Each thread has a private buffer of chunk size and takes pieces one by one
+ * from the common list. All threads share a single descriptor of the input
+ * file. It's safe because only positioned reads are used. When the
+ * memory-mapping engine is used, the threads share a single mapping of the
+ * input file and don't need private buffers
+ */
+int split_CopyPieces( const split_Opts_t* const opts,
+                      const std::vector<split_Piece_t> & plan)
+{
+    char err_msg[500];
+    int fd_input = open( (opts->input_path).c_str(), O_RDONLY);
+
+    if ( fd_input == -1 )
+    {
+        SPLIT_ERROR( "Cannot open file \"%s\": %s", (opts->input_path).c_str(),
+                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+    }
+
+    int num_digits = split_CalcNumWidth( opts->num_pieces);
+    int64_t num_threads = std::min( opts->num_threads, (int64_t)plan.size());
+    int64_t input_size = plan.back().offset + plan.back().size;
+    const char *input_map = NULL;
+
+    split_SetProgressTotal( input_size);
+    split_AdviseInput( fd_input, POSIX_FADV_SEQUENTIAL);
+
+    split_OnError_t close_input( [&]()
+    {
+        if ( input_map )
+        {
+            munmap( (void *)input_map, input_size);
+        }
+
+        close( fd_input);
+    });
+
+    if ( (opts->engine == SPLIT_ENGINE_MMAP) && input_size )
+    {
+        input_map = split_MapInput( fd_input, input_size);
+    }
+
+    std::atomic<int64_t> next_piece( 0);
+    std::vector<std::thread> threads;
+
+    /* When a thread fails, the others stop taking pieces. The error is thrown
+       when all of them are joined */
+    for ( int64_t i = 0; i < num_threads; i++ )
+    {
+        threads.push_back( split_StartWorker( NULL, NULL, [&]()
+        {
+            char *buff = NULL;
+
+            if ( !input_map && !(buff = (char *)malloc( opts->buffer_size)) )
+            {
+                SPLIT_ERROR( "Couldn't allocate internal buffer of size %ld",
+                             opts->buffer_size);
+            }
+
+            split_OnError_t free_buffer( [&]()
+            {
+                free( buff);
+            });
+
+            for ( int64_t piece_num = next_piece++;
+                  (piece_num < (int64_t)plan.size()) && !split_workers->is_failed;
+                  piece_num = next_piece++ )
+            {
+                split_CopyPiece( opts, fd_input, input_map, buff, num_digits,
+                                 piece_num, plan[piece_num]);
+            }
+
+            free( buff);
+        }));
+    }
+
+    for ( size_t i = 0; i < threads.size(); i++ )
+    {
+        threads[i].join();
+    }
+
+    split_CheckWorkers();
+
+    if ( input_map )
+    {
+        munmap( (void *)input_map, input_size);
+    }
+
+    close( fd_input);
+
+    return 0;
+}
+
+/**
+ * Submission and completion queues of an io_uring instance
+ *
+ * The library "liburing" is not used. The rings are set up with raw system
+ * calls, which is simple enough for the few operations needed here
+ */
+typedef struct
+{
+    /* io_uring file descriptor */
+    int fd;
+    /* Submission queue */
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned *sq_array;
+    unsigned sq_entries;
+    struct io_uring_sqe *sqes;
+    /* Number of prepared submission entries not yet passed to the kernel */
+    unsigned num_unsubmitted;
+    /* Completion queue */
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    /* Mappings of the rings */
+    void *sq_ptr;
+    size_t sq_len;
+    void *cq_ptr;
+    size_t cq_len;
+    size_t sqes_len;
+} split_Uring_t;
+
+/* Types of operations submitted to io_uring. They are encoded in two lower
+   bits of "user_data" */
+#define SPLIT_URING_OP_READ 0
+#define SPLIT_URING_OP_WRITE 1
+#define SPLIT_URING_OP_FSYNC 2
+
+/**
+ * Set up io_uring instance with at least "entries" submission entries
+ *
+ * Return value: "0" on success, "-1" if io_uring is not available or doesn't
+ *               support some needed operation. "errno" explains the reason
+ */
+static int split_SetupUring( split_Uring_t *ring, unsigned entries)
+{
+    struct io_uring_params params;
+
+    memset( &params, 0, sizeof( params));
+    ring->fd = syscall( __NR_io_uring_setup, entries, &params);
+
+    if ( ring->fd == -1 )
+    {
+        return -1;
+    }
+
+    /* Check that all needed operations are supported. Reads and writes with
+       explicit offsets appeared in io_uring later than io_uring itself */
+    size_t probe_size = sizeof( struct io_uring_probe)
+                        + 256 * sizeof( struct io_uring_probe_op);
+    struct io_uring_probe *probe = (struct io_uring_probe *)calloc( 1, probe_size);
+    int ops[] = {IORING_OP_READ, IORING_OP_WRITE, IORING_OP_FSYNC};
+
+    if ( !probe )
+    {
+        SPLIT_ERROR( "Couldn't allocate memory for io_uring probe");
+    }
+
+    if ( syscall( __NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE,
+                  probe, 256) == -1 )
+    {
+        free( probe);
+        close( ring->fd);
+
+        return -1;
+    }
+
+    for ( size_t i = 0; i < sizeof( ops) / sizeof( ops[0]); i++ )
+    {
+        if ( (ops[i] > probe->last_op)
+             || !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED) )
+        {
+            free( probe);
+            close( ring->fd);
+            errno = EOPNOTSUPP;
+
+            return -1;
+        }
+    }
+
+    free( probe);
+
+    ring->sq_len = params.sq_off.array + params.sq_entries * sizeof( unsigned);
+    ring->cq_len = params.cq_off.cqes
+                   + params.cq_entries * sizeof( struct io_uring_cqe);
+
+    if ( params.features & IORING_FEAT_SINGLE_MMAP )
+    {
+        ring->sq_len = ring->cq_len = std::max( ring->sq_len, ring->cq_len);
+    }
+
+    char err_msg[500];
+
+    ring->sq_ptr = mmap( NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+
+    if ( ring->sq_ptr == MAP_FAILED )
+    {
+        SPLIT_ERROR( "Cannot map io_uring submission queue: %s",
+                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+    }
+
+    if ( params.features & IORING_FEAT_SINGLE_MMAP )
+    {
+        ring->cq_ptr = ring->sq_ptr;
+    } else
+    {
+        ring->cq_ptr = mmap( NULL, ring->cq_len, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+
+        if ( ring->cq_ptr == MAP_FAILED )
+        {
+            SPLIT_ERROR( "Cannot map io_uring completion queue: %s",
+                         SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+        }
+    }
+
+    ring->sqes_len = params.sq_entries * sizeof( struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe *)mmap( NULL, ring->sqes_len,
+                                              PROT_READ | PROT_WRITE,
+                                              MAP_SHARED | MAP_POPULATE, ring->fd,
+                                              IORING_OFF_SQES);
+
+    if ( ring->sqes == MAP_FAILED )
+    {
+        SPLIT_ERROR( "Cannot map io_uring submission entries: %s",
+                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+    }
+
+    char *sq = (char *)ring->sq_ptr;
+    char *cq = (char *)ring->cq_ptr;
+
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->sq_entries = params.sq_entries;
+    ring->num_unsubmitted = 0;
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    return 0;
+}
+
+/**
+ * Release io_uring instance
+ */
+static void split_DestroyUring( split_Uring_t *ring)
+{
+    munmap( ring->sqes, ring->sqes_len);
+
+    if ( ring->cq_ptr != ring->sq_ptr )
+    {
+        munmap( ring->cq_ptr, ring->cq_len);
+    }
+
+    munmap( ring->sq_ptr, ring->sq_len);
+    close( ring->fd);
+}
+
+/**
+ * Prepare next submission entry. The caller guarantees that the submission
+ * queue is not full
+ */
+static struct io_uring_sqe *split_GetUringSqe( split_Uring_t *ring,
+                                               int opcode,
+                                               int fd,
+                                               uint64_t user_data)
+{
+    unsigned tail = *ring->sq_tail + ring->num_unsubmitted;
+    unsigned index = tail & ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+
+    SPLIT_ASSERT( tail - __atomic_load_n( ring->sq_head, __ATOMIC_ACQUIRE)
+                  < ring->sq_entries);
+    memset( sqe, 0, sizeof( *sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->user_data = user_data;
+    ring->sq_array[index] = index;
+    ring->num_unsubmitted++;
+
+    return sqe;
+}
+
+/**
+ * Pass prepared submission entries to the kernel and wait for at least one
+ * completion
+ */
+static void split_SubmitUring( split_Uring_t *ring)
+{
+    char err_msg[500];
+    unsigned to_submit = ring->num_unsubmitted;
+
+    __atomic_store_n( ring->sq_tail, *ring->sq_tail + to_submit, __ATOMIC_RELEASE);
+    ring->num_unsubmitted = 0;
+
+    while ( syscall( __NR_io_uring_enter, ring->fd, to_submit, 1,
+                     IORING_ENTER_GETEVENTS, NULL, 0) == -1 )
+    {
+        if ( errno != EINTR )
+        {
+            SPLIT_ERROR( "Cannot submit I/O requests to io_uring: %s",
+                         SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+        }
+    }
+}
+
+/**
+ * Wait for completion of "num_in_flight" requests after a failure, so that
+ * buffers used by the requests may be released. Results of the requests are
+ * ignored. Prepared entries not yet passed to the kernel are dropped
+ *
+ * Return value: "true" if all the requests completed, "false" if io_uring
+ *               failed and some requests may still be in flight
+ */
+static bool split_DrainUring( split_Uring_t *ring, unsigned num_in_flight)
+{
+    num_in_flight -= ring->num_unsubmitted;
+    ring->num_unsubmitted = 0;
+
+    while ( num_in_flight )
+    {
+        unsigned head = *ring->cq_head;
+        unsigned tail = __atomic_load_n( ring->cq_tail, __ATOMIC_ACQUIRE);
+
+        if ( head != tail )
+        {
+            num_in_flight -= tail - head;
+            __atomic_store_n( ring->cq_head, tail, __ATOMIC_RELEASE);
+
+            continue;
+        }
+
+        /* Entries the kernel hasn't consumed yet are submitted along */
+        unsigned to_submit = *ring->sq_tail
+                             - __atomic_load_n( ring->sq_head, __ATOMIC_ACQUIRE);
+
+        if ( (syscall( __NR_io_uring_enter, ring->fd, to_submit, 1,
+                       IORING_ENTER_GETEVENTS, NULL, 0) == -1)
+             && (errno != EINTR) )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * State of a piece being copied by the io_uring engine
+ */
+typedef struct
+{
+    /* Output file descriptor. "-1" if the file is not created yet */
+    int fd;
+    /* Number of writes submitted but not completed */
+    int64_t num_writes_in_flight;
+    /* Indicator that all writes of the piece were submitted */
+    bool is_fully_submitted;
+} split_UringPiece_t;
+
+/**
+ * Copy planned pieces to output files using io_uring
+ *
+ * A single thread keeps up to "ring_depth" chunks in flight. Each chunk is
+ * read to a private buffer and written to its place in the output file by
+ * two linked requests, so the write starts as soon as the read completes.
+ * Chunks are submitted in batches. When all writes of a piece complete, the
+ * piece is synced by an asynchronous request, so syncs of different pieces
+ * don't wait for each other and overlap with copying of next pieces. That
+ * serves both "each" and "deferred" modes of syncing. In other modes pieces
+ * are not synced here (see "sync.cpp")
+ *
+ * Return value: "0" on success, "-1" if io_uring is not available. In the
+ *               latter case nothing is written and "errno" explains the reason
+ */
+int split_CopyPiecesUring( const split_Opts_t* const opts,
+                           const std::vector<split_Piece_t> & plan)
+{
+    char err_msg[500];
+    int64_t depth = opts->ring_depth;
+    split_Uring_t ring;
+
+    /* Each chunk takes two submission entries. The rest is for syncs */
+    if ( split_SetupUring( &ring, 4 * depth) == -1 )
+    {
+        return -1;
+    }
+
+    /* Resources are released if copying fails */
+    split_OnError_t destroy_ring( [&]()
+    {
+        split_DestroyUring( &ring);
+    });
+
+    int fd_input = open( (opts->input_path).c_str(), O_RDONLY);
+
+    if ( fd_input == -1 )
+    {
+        SPLIT_ERROR( "Cannot open file \"%s\": %s", (opts->input_path).c_str(),
+                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+    }
+
+    split_OnError_t close_input( [&]()
+    {
+        close( fd_input);
+    });
+
+    int num_digits = split_CalcNumWidth( opts->num_pieces);
+    int64_t num_pieces = plan.size();
+    std::vector<split_UringPiece_t> pieces( num_pieces);
+
+    split_SetProgressTotal( plan.back().offset + plan.back().size);
+    split_AdviseInput( fd_input, POSIX_FADV_SEQUENTIAL);
+
+    /* Buffers and free-list of buffers. Buffers not allocated yet are NULL */
+    std::vector<char *> buffs( depth);
+    std::vector<int64_t> free_buffs;
+    /* Piece and size of the chunk being copied through each buffer */
+    std::vector<int64_t> buff_piece( depth), buff_size( depth);
+    /* Pieces ready to be synced */
+    std::deque<int64_t> ready_pieces;
+    /* Next chunk to submit */
+    int64_t piece_num = 0, piece_offset = 0;
+    int64_t num_done = 0;
+    /* Number of requests submitted but not completed */
+    unsigned num_in_flight = 0;
+
+    for ( int64_t i = 0; i < num_pieces; i++ )
+    {
+        pieces[i].fd = -1;
+        pieces[i].num_writes_in_flight = 0;
+        pieces[i].is_fully_submitted = false;
+    }
+
+    split_OnError_t close_pieces( [&]()
+    {
+        for ( int64_t i = 0; i < num_pieces; i++ )
+        {
+            if ( pieces[i].fd != -1 )
+            {
+                close( pieces[i].fd);
+            }
+        }
+    });
+
+    /* Requests still in flight may use buffers and output files. So they are
+       waited for before the buffers are freed and the files are closed. If
+       waiting fails, the buffers are left to the kernel */
+    split_OnError_t free_buffs_on_error( [&]()
+    {
+        if ( !split_DrainUring( &ring, num_in_flight) )
+        {
+            return;
+        }
+
+        for ( int64_t i = 0; i < depth; i++ )
+        {
+            free( buffs[i]);
+        }
+    });
+
+    for ( int64_t i = 0; i < depth; i++ )
+    {
+        if ( !(buffs[i] = (char *)malloc( opts->buffer_size)) )
+        {
+            SPLIT_ERROR( "Couldn't allocate internal buffer of size %ld",
+                         opts->buffer_size);
+        }
+
+        free_buffs.push_back( i);
+    }
+
+    while ( num_done < num_pieces )
+    {
+        /* Submit as many chunks as possible */
+        while ( !free_buffs.empty() && (piece_num < num_pieces)
+                && (num_in_flight + 2 <= ring.sq_entries) )
+        {
+            split_UringPiece_t & piece = pieces[piece_num];
+            int64_t buff_num = free_buffs.back();
+            int64_t io_size = std::min( opts->buffer_size,
+                                        plan[piece_num].size - piece_offset);
+
+            free_buffs.pop_back();
+
+            if ( piece.fd == -1 )
+            {
+                piece.fd = split_StartNewPiece( opts->output_dir, opts->output_file,
+                                                opts->output_extension,
+                                                num_digits, piece_num);
+                split_PreallocateOutput( piece.fd, plan[piece_num].size);
+            }
+
+            struct io_uring_sqe *sqe = split_GetUringSqe( &ring, IORING_OP_READ,
+                                                          fd_input,
+                                                          (buff_num << 2)
+                                                          | SPLIT_URING_OP_READ);
+
+            sqe->addr = (uint64_t)buffs[buff_num];
+            sqe->len = io_size;
+            sqe->off = plan[piece_num].offset + piece_offset;
+            sqe->flags = IOSQE_IO_LINK;
+            sqe = split_GetUringSqe( &ring, IORING_OP_WRITE, piece.fd,
+                                     (buff_num << 2) | SPLIT_URING_OP_WRITE);
+            sqe->addr = (uint64_t)buffs[buff_num];
+            sqe->len = io_size;
+            sqe->off = piece_offset;
+            buff_piece[buff_num] = piece_num;
+            buff_size[buff_num] = io_size;
+            piece.num_writes_in_flight++;
+            num_in_flight += 2;
+            piece_offset += io_size;
+
+            if ( piece_offset == plan[piece_num].size )
+            {
+                piece.is_fully_submitted = true;
+                piece_num++;
+                piece_offset = 0;
+            }
+        }
+
+        /* Submit syncs of pieces which writes are complete */
+        while ( !ready_pieces.empty() && (num_in_flight < ring.sq_entries) )
+        {
+            int64_t ready_num = ready_pieces.front();
+
+            ready_pieces.pop_front();
+            split_GetUringSqe( &ring, IORING_OP_FSYNC, pieces[ready_num].fd,
+                               (ready_num << 2) | SPLIT_URING_OP_FSYNC);
+            num_in_flight++;
+        }
+
+        split_SubmitUring( &ring);
+
+        /* Process completions. Each completion is released right away, so
+           "num_in_flight" stays exact if processing fails */
+        unsigned head = *ring.cq_head;
+
+        while ( head != __atomic_load_n( ring.cq_tail, __ATOMIC_ACQUIRE) )
+        {
+            struct io_uring_cqe *cqe = &ring.cqes[head & ring.cq_mask];
+            uint64_t user_data = cqe->user_data;
+            int64_t id = user_data >> 2;
+            int res = cqe->res;
+
+            __atomic_store_n( ring.cq_head, ++head, __ATOMIC_RELEASE);
+            num_in_flight--;
+
+            switch ( user_data & 3 )
+            {
+                case SPLIT_URING_OP_READ:
+                    if ( res < 0 )
+                    {
+                        errno = -res;
+                        SPLIT_ERROR( "Cannot read data from the input file: %s",
+                                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+                    } else if ( res != buff_size[id] )
+                    {
+                        SPLIT_ERROR( "Read %d bytes from the input file. %ld bytes "
+                                     "were expected. Was the file truncated?", res,
+                                     buff_size[id]);
+                    }
+
+                    break;
+
+                case SPLIT_URING_OP_WRITE:
+                {
+                    split_UringPiece_t & piece = pieces[buff_piece[id]];
+
+                    if ( res < 0 )
+                    {
+                        errno = -res;
+                        SPLIT_ERROR( "Cannot write data to output file: %s",
+                                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+                    } else if ( res != buff_size[id] )
+                    {
+                        SPLIT_ERROR( "Written %d bytes to an output file. %ld bytes "
+                                     "were expected. Is it a regular storage device?",
+                                     res, buff_size[id]);
+                    }
+
+                    free_buffs.push_back( id);
+                    split_AddProgress( res);
+                    piece.num_writes_in_flight--;
+
+                    if ( !piece.is_fully_submitted || piece.num_writes_in_flight )
+                    {
+                        break;
+                    }
+
+                    if ( (opts->sync_mode == SPLIT_SYNC_EACH)
+                         || (opts->sync_mode == SPLIT_SYNC_DEFERRED) )
+                    {
+                        ready_pieces.push_back( buff_piece[id]);
+                    } else
+                    {
+                        /* The piece is synced at the end or not synced at all */
+                        close( piece.fd);
+                        piece.fd = -1;
+                        split_ReportPiece( buff_piece[id], plan[buff_piece[id]].size);
+                        num_done++;
+                    }
+
+                    break;
+                }
+
+                case SPLIT_URING_OP_FSYNC:
+                    if ( res < 0 )
+                    {
+                        errno = -res;
+                        SPLIT_ERROR( "Cannot sync output file: %s",
+                                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+                    }
+
+                    close( pieces[id].fd);
+                    pieces[id].fd = -1;
+                    split_ReportPiece( id, plan[id].size);
+                    num_done++;
+
+                    break;
+
+                default:
+                    SPLIT_ASSERT( 0);
+            }
+        }
+    }
+
+    for ( int64_t i = 0; i < depth; i++ )
+    {
+        free( buffs[i]);
+    }
+
+    close( fd_input);
+    split_DestroyUring( &ring);
+
+    return 0;
+}
+
+/**
+ * Calculate size and CRC32 of the tail of the input file ending at "end" (see
+ * "manifest.cpp")
+ */
+static void split_CalcInputTail( const split_Opts_t* const opts,
+                                 int64_t end,
+                                 split_Manifest_t *manifest)
+{
+    char err_msg[500];
+    char buff[SPLIT_MANIFEST_TAIL_SIZE];
+    int fd = open( (opts->input_path).c_str(), O_RDONLY);
+
+    if ( fd == -1 )
+    {
+        SPLIT_ERROR( "Cannot open file \"%s\": %s", (opts->input_path).c_str(),
+                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+    }
+
+    manifest->tail_size = std::min( end, (int64_t)SPLIT_MANIFEST_TAIL_SIZE);
+    split_ReadInputAt( fd, buff, manifest->tail_size, end - manifest->tail_size);
+    manifest->tail_crc = crc32( crc32( 0, Z_NULL, 0), (const Bytef *)buff,
+                                manifest->tail_size);
+    close( fd);
+}
+
+/**
+ * Write manifest of planned pieces (see "manifest.cpp")
+ */
+static void split_WritePlanManifest( const split_Opts_t* const opts,
+                                     const std::vector<split_Piece_t> & plan)
+{
+    split_Manifest_t manifest;
+    std::string path = opts->output_dir + "/" + opts->output_file + ".manifest";
+
+    manifest.input_path = opts->input_path;
+    manifest.input_size = 0;
+
+    for ( size_t i = 0; i < plan.size(); i++ )
+    {
+        split_ManifestPiece_t piece = {plan[i].offset, plan[i].size, -1};
+
+        /* Fixed-size records are counted arithmetically. The header belongs
+           to the first piece */
+        if ( opts->record_size )
+        {
+            piece.num_records = (plan[i].size - (i ? 0 : std::min( opts->header_size,
+                                                                    plan[i].size)))
+                                / opts->record_size;
+        }
+
+        manifest.pieces.push_back( piece);
+        manifest.input_size += plan[i].size;
+    }
+
+    split_CalcInputTail( opts, manifest.input_size, &manifest);
+    split_WriteManifest( path, &manifest);
+    SPLIT_OUT( "Manifest of %ld pieces written to \"%s\"", (int64_t)plan.size(),
+               path.c_str());
+}
+
+/**
+ * Split a growing input file incrementally
+ *
+ * The manifest of the previous split is kept in the output directory. Pieces
+ * of the previous split are kept, except for the last one. It's split again
+ * starting from its offset, so it's topped up with the appended data, and
+ * new pieces follow. Before that the tail of the data split previously is
+ * checked to be unchanged
+ */
+static void split_SplitIncrementally( split_Opts_t *opts)
+{
+    std::string path = opts->output_dir + "/" + opts->output_file + ".manifest";
+    split_Manifest_t manifest;
+    std::vector<split_ManifestPiece_t> written;
+    char err_msg[500];
+
+    if ( split_ReadManifest( path, &manifest) )
+    {
+        split_Manifest_t current;
+        int fd = open( (opts->input_path).c_str(), O_RDONLY);
+
+        if ( fd == -1 )
+        {
+            SPLIT_ERROR( "Cannot open file \"%s\": %s", (opts->input_path).c_str(),
+                         SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+        }
+
+        int64_t input_size = split_GetInputSize( fd);
+
+        close( fd);
+
+        if ( input_size < manifest.input_size )
+        {
+            SPLIT_ERROR( "Input file is smaller than when it was split last time. "
+                         "It should be split from scratch");
+        }
+
+        split_CalcInputTail( opts, manifest.input_size, &current);
+
+        if ( (current.tail_size != manifest.tail_size)
+             || (current.tail_crc != manifest.tail_crc) )
+        {
+            SPLIT_ERROR( "Input file was modified since it was split last time. "
+                         "It should be split from scratch");
+        }
+
+        if ( input_size == manifest.input_size )
+        {
+            SPLIT_OUT( "No data was appended to the input file since it was split "
+                       "last time");
+
+            return;
+        }
+
+        if ( !manifest.pieces.empty() )
+        {
+            std::string last_name = split_GetPieceName( opts->output_dir,
+                                                        opts->output_file,
+                                                        opts->output_extension, 1,
+                                                        manifest.pieces.size() - 1);
+
+            opts->start_offset = manifest.pieces.back().offset;
+            opts->first_piece = manifest.pieces.size() - 1;
+            manifest.pieces.pop_back();
+
+            if ( (unlink( last_name.c_str()) == -1) && (errno != ENOENT) )
+            {
+                SPLIT_ERROR( "Cannot remove output file \"%s\": %s",
+                             last_name.c_str(),
+                             SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+            }
+        }
+    }
+
+    split_SplitSource( opts, NULL, &written);
+    manifest.input_path = opts->input_path;
+    manifest.input_size = opts->start_offset;
+
+    for ( size_t i = 0; i < written.size(); i++ )
+    {
+        manifest.pieces.push_back( written[i]);
+        manifest.input_size += written[i].size;
+    }
+
+    split_CalcInputTail( opts, manifest.input_size, &manifest);
+    split_WriteManifest( path, &manifest);
+}
+
+/**
+ * Run a split with given options
+ */
+static void split_Run( split_Opts_t *opts)
+{
+    if ( opts->distribution )
+    {
+        split_DistributeSource( opts);
+    } else if ( opts->is_incremental )
+    {
+        split_SplitIncrementally( opts);
+    } else if ( opts->is_plan_only )
+    {
+        std::vector<split_Piece_t> plan;
+
+        split_SplitSource( opts, &plan, NULL);
+        split_WritePlanManifest( opts, plan);
+    } else if ( split_IsPlanned( opts) )
+    {
+        std::vector<split_Piece_t> plan;
+
+        split_SplitSource( opts, &plan, NULL);
+
+        bool is_copied = false;
+
+        if ( opts->engine == SPLIT_ENGINE_URING )
+        {
+            char err_msg[500];
+
+            is_copied = !split_CopyPiecesUring( opts, plan);
+
+            if ( !is_copied )
+            {
+                SPLIT_OUT( "Warning: io_uring is not available (%s). Falling back "
+                           "to the \"rw\" engine",
+                           SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+            }
+        }
+
+        if ( !is_copied )
+        {
+            split_CopyPieces( opts, plan);
+        }
+    } else
+    {
+        split_SplitSource( opts, NULL, NULL);
+    }
+}
+
+/**
+ * State of a split (see "split_context")
+ */
+struct split_Context_t
+{
+    split_Messages_t messages;
+    split_Workers_t workers;
+    split_SinkState_t sink_state;
+    split_ZeroCopy_t zero_copy;
+    split_Stats_t stats;
+    split_Syncer_t syncer;
+};
+
+/**
+ * Bind the current thread to the state of a split. "context" may be NULL
+ */
+static void split_BindContext( split_Context_t *context)
+{
+    split_context = context;
+    split_messages = context ? &context->messages : NULL;
+    split_workers = context ? &context->workers : NULL;
+    split_sink_state = context ? &context->sink_state : NULL;
+    split_zero_copy = context ? &context->zero_copy : NULL;
+    split_stats = context ? &context->stats : NULL;
+    split_syncer = context ? &context->syncer : NULL;
+}
+
+/* Lock serializing parsing of options. The state of "getopt_long()" is
+   global */
+static std::mutex split_parse_lock;
+
+namespace split
+{
+
+Error::Error( const std::string & message, bool is_usage)
+    : std::runtime_error( message), is_usage( is_usage)
+{
+}
+
+bool Error::IsUsage() const
+{
+    return is_usage;
+}
+
+struct Splitter::Impl
+{
+    split_Opts_t opts;
+    Sink *sink;
+    LogHandler on_message;
+};
+
+Splitter::Splitter( const std::vector<std::string> & args) : impl( new Impl())
+{
+    /* "getopt_long()" expects modifiable strings and the name of the program */
+    std::vector<std::vector<char> > strings( 1, std::vector<char>( 1, 0));
+    std::vector<char *> argv;
+
+    for ( size_t i = 0; i < args.size(); i++ )
+    {
+        strings.push_back( std::vector<char>( args[i].begin(), args[i].end()));
+        strings.back().push_back( 0);
+    }
+
+    for ( size_t i = 0; i < strings.size(); i++ )
+    {
+        argv.push_back( strings[i].data());
+    }
+
+    argv.push_back( NULL);
+    impl->sink = NULL;
+    split_InitOpts( &impl->opts);
+
+    std::lock_guard<std::mutex> guard( split_parse_lock);
+
+    split_ParseCmdLine( argv.size() - 1, argv.data(), &impl->opts);
+}
+
+Splitter::~Splitter()
+{
+}
+
+void Splitter::SetSink( Sink *sink)
+{
+    impl->sink = sink;
+}
+
+void Splitter::SetLogHandler( LogHandler on_message)
+{
+    impl->on_message = on_message;
+}
+
+void Splitter::Split()
+{
+    /* Options are modified by incremental splits */
+    split_Opts_t opts = impl->opts;
+    bool is_file_sink = impl->sink && (typeid( *impl->sink) == typeid( FileSink));
+
+    if ( is_file_sink )
+    {
+        FileSink *file_sink = (FileSink *)impl->sink;
+
+        opts.output_dir = file_sink->GetDir();
+
+        if ( !file_sink->GetName().empty() )
+        {
+            opts.output_file = file_sink->GetName();
+        }
+    } else if ( impl->sink && ((!opts.distribution && split_IsPlanned( &opts))
+                               || opts.is_direct || opts.is_plan_only
+                               || opts.is_incremental) )
+    {
+        split_FailWithAssist( "Pieces can be passed to a sink only by the \"rw\" and "
+                              "\"pipeline\" engines when bounds of pieces are not "
+                              "planned in advance, and not in direct I/O, plan-only "
+                              "and incremental modes");
+    }
+
+    /* The split gets a state of its own. Afterwards the thread is bound back
+       to the split it was running before, if any (a sink or a receiver of
+       messages may run a split within a split) */
+    std::unique_ptr<split_Context_t> context( new split_Context_t());
+    split_Context_t *outer_context = split_context;
+
+    context->sink_state.sink = is_file_sink ? NULL : impl->sink;
+    context->messages.handler = impl->on_message;
+    split_BindContext( context.get());
+
+    try
+    {
+        split_StartStats( opts.is_stats, opts.is_progress);
+        /* Pieces passed to a sink are not synced */
+        split_StartSyncer( split_sink_state->sink ? SPLIT_SYNC_NONE : opts.sync_mode,
+                           opts.output_dir);
+        split_Run( &opts);
+        split_StopSyncer();
+        split_CheckWorkers();
+        split_StopStats();
+    } catch ( ... )
+    {
+        split_AbortSyncer();
+        split_AbortStats();
+        split_BindContext( outer_context);
+
+        throw;
+    }
+
+    split_BindContext( outer_context);
+}
+
+std::string Splitter::GetUsage( const std::string & prog_name)
+{
+    return split_GetHelp( prog_name.c_str());
+}
+
+} /* namespace split */
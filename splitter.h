@@ -0,0 +1,216 @@
+/**
+ * Copyright © 2016 Andrey Nevolin, https://github.com/AndreyNevolin
+ * Twitter: @Andrey_Nevolin
+ * LinkedIn: https://www.linkedin.com/in/andrey-nevolin-76387328
+ *
+ * Interface of the splitting library
+ *
+ * The library splits files exactly as the tool does. The tool itself is a
+ * thin layer on top of it (see "split.cpp"). A split is configured by the
+ * options of the tool, and errors are reported by exceptions instead of
+ * exiting the process:
+ *
+ *     split::MemorySink sink;
+ *     split::Splitter splitter( {"-n", "4", "--format", "fastq", "reads.fq"});
+ *
+ *     splitter.SetSink( &sink);
+ *     splitter.Split();
+ *
+ *     std::vector<char> first = sink.TakePiece( 0);
+ *
+ * Pieces go to a sink. By default, and with "FileSink", they are written to
+ * files. "MemorySink" collects pieces in memory, and "CallbackSink" passes
+ * the data to functions right from the buffers of the splitter, without
+ * copying. Sinks other than "FileSink" are supported by the "rw" and
+ * "pipeline" engines when bounds of pieces are not planned in advance
+ * (several threads with uncompressed files), and not in direct I/O, plan-only
+ * and incremental modes
+ *
+ * The splitter is quiet. Messages (sizes of written pieces, warnings) are
+ * passed to a handler if one is set, and the tool prints them. Statistics and
+ * progress are printed to the standard error only if requested by the options
+ * ("--stats", "--progress")
+ *
+ * Each split has a state of its own. So splits may run concurrently in
+ * different threads, and a sink or a handler of messages may run a split of
+ * its own. A splitter may run several splits at once if each of them has its
+ * own sink
+ */
+
+#ifndef SPLITTER_H
+#define SPLITTER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <functional>
+#include <stdexcept>
+
+namespace split
+{
+
+/**
+ * Error of a split. Errors in the options are "usage" errors
+ */
+class Error : public std::runtime_error
+{
+public:
+    Error( const std::string & message, bool is_usage = false);
+
+    bool IsUsage() const;
+
+private:
+    bool is_usage;
+};
+
+/**
+ * Consumer of pieces
+ *
+ * Methods are called in the thread running the split. A piece is started,
+ * its data is written in the order of the input, and the piece is finished
+ * with its total size. When records are dealt to pieces ("--distribute"),
+ * all pieces are started at once and writes to them interleave. The data
+ * passed to "Write()" is valid only during the call. An exception thrown by
+ * a method fails the split
+ */
+class Sink
+{
+public:
+    virtual ~Sink() {}
+
+    /* "name" is the name of the output file the piece would be written to */
+    virtual void StartPiece( int64_t piece_num, const std::string & name) = 0;
+    virtual void Write( int64_t piece_num, const char *data, int64_t size) = 0;
+    virtual void FinishPiece( int64_t piece_num, int64_t size) = 0;
+};
+
+/**
+ * Sink writing pieces to files in a directory ("--od"). Pieces are named
+ * after the input file or after "name" if it's not empty ("--of")
+ *
+ * This very class is recognized by the splitter, and pieces are written by
+ * the engines of the tool, with all their options. Methods of a derived
+ * class are called as of any other sink
+ */
+class FileSink : public Sink
+{
+public:
+    FileSink( const std::string & dir, const std::string & name = "");
+
+    const std::string & GetDir() const;
+    const std::string & GetName() const;
+
+    void StartPiece( int64_t piece_num, const std::string & name);
+    void Write( int64_t piece_num, const char *data, int64_t size);
+    void FinishPiece( int64_t piece_num, int64_t size);
+
+private:
+    std::string dir;
+    std::string name;
+    /* Descriptors of files of unfinished pieces */
+    std::map<int64_t, int> fds;
+};
+
+/**
+ * Sink collecting pieces in memory
+ *
+ * Finished pieces are passed to "on_piece" if it's set. Otherwise they are
+ * kept by the sink until taken. Pieces are moved, not copied
+ */
+class MemorySink : public Sink
+{
+public:
+    typedef std::function<void( int64_t piece_num, std::vector<char> && data)>
+        PieceHandler;
+
+    MemorySink( PieceHandler on_piece = PieceHandler());
+
+    /* Numbers of finished pieces kept by the sink */
+    std::vector<int64_t> GetPieceNums() const;
+    /* Take a finished piece out of the sink */
+    std::vector<char> TakePiece( int64_t piece_num);
+
+    void StartPiece( int64_t piece_num, const std::string & name);
+    void Write( int64_t piece_num, const char *data, int64_t size);
+    void FinishPiece( int64_t piece_num, int64_t size);
+
+private:
+    PieceHandler on_piece;
+    /* Unfinished pieces */
+    std::map<int64_t, std::vector<char> > pieces;
+    /* Finished pieces */
+    std::map<int64_t, std::vector<char> > finished;
+};
+
+/**
+ * Sink passing data of pieces to functions. Only "on_data" is required. The
+ * data points to the buffers of the splitter and is valid only during the
+ * call, so a piece is consumed without copying
+ */
+class CallbackSink : public Sink
+{
+public:
+    typedef std::function<void( int64_t piece_num, const std::string & name)>
+        StartHandler;
+    typedef std::function<void( int64_t piece_num, const char *data, int64_t size)>
+        DataHandler;
+    typedef std::function<void( int64_t piece_num, int64_t size)> FinishHandler;
+
+    CallbackSink( DataHandler on_data,
+                  StartHandler on_start = StartHandler(),
+                  FinishHandler on_finish = FinishHandler());
+
+    void StartPiece( int64_t piece_num, const std::string & name);
+    void Write( int64_t piece_num, const char *data, int64_t size);
+    void FinishPiece( int64_t piece_num, int64_t size);
+
+private:
+    DataHandler on_data;
+    StartHandler on_start;
+    FinishHandler on_finish;
+};
+
+/**
+ * Splitter of a file
+ *
+ * "args" are options of the tool followed by paths to input files, without
+ * the name of the program (for example, {"-n", "4", "reads.fa"}). They are
+ * checked right away. A splitter may split its input several times
+ */
+class Splitter
+{
+public:
+    /* Receiver of a message of a split. The message is a single line without
+       a newline. Messages may come from worker threads, but the handler is
+       not called concurrently. An exception thrown by the handler fails the
+       split */
+    typedef std::function<void( const std::string & message)> LogHandler;
+
+    Splitter( const std::vector<std::string> & args);
+    ~Splitter();
+
+    /* Set consumer of pieces. The sink is not owned by the splitter. If it's
+       NULL, pieces are written to files as configured by the options */
+    void SetSink( Sink *sink);
+    /* Set receiver of messages. Messages are dropped if it's empty (the
+       default) */
+    void SetLogHandler( LogHandler on_message);
+    void Split();
+
+    /* Usage guidelines of the tool. Lines end with newlines */
+    static std::string GetUsage( const std::string & prog_name);
+
+private:
+    struct Impl;
+
+    std::unique_ptr<Impl> impl;
+
+    Splitter( const Splitter &);
+    Splitter & operator=( const Splitter &);
+};
+
+} /* namespace split */
+
+#endif /* SPLITTER_H */
@@ -0,0 +1,490 @@
+/**
+ * Copyright © 2016 Andrey Nevolin, https://github.com/AndreyNevolin
+ * Twitter: @Andrey_Nevolin
+ * LinkedIn: https://www.linkedin.com/in/andrey-nevolin-76387328
+ *
+ * Instrumentation of a split and its live progress
+ *
+ * Time spent in each phase of the split is accumulated together with the
+ * number of calls and the amount of data processed. Latencies of I/O calls
+ * are also collected into histograms with power-of-two buckets (in
+ * microseconds). Timers are read only when statistics are requested, so the
+ * cost of disabled instrumentation is a check of a flag per chunk. Requests
+ * of the io_uring engine complete asynchronously and are not timed
+ *
+ * For each bound of a piece found in the data, the distance between the
+ * projected bound and the found one is recorded. Bound finders scan outward
+ * from the projected bound, so it's the minimum amount of data scanned to find
+ * the bound. Sizes of written pieces are recorded to measure the imbalance
+ * between them. The peak amount of memory taken by data buffers is recorded,
+ * because chunks grow to fit big elements
+ *
+ * Progress is tracked by a single counter of input bytes transferred to
+ * output files. The counter is bumped once per chunk, and a separate thread
+ * samples it to print the progress line. So the splitting loop never waits
+ * for the progress to be printed
+ */
+
+#include <time.h>
+#include <map>
+
+/* Number of buckets of latency histograms. The last bucket takes all
+   latencies above 2^30 microseconds */
+#define SPLIT_STATS_NUM_BUCKETS 32
+/* Interval of updating the progress line in milliseconds */
+#define SPLIT_PROGRESS_INTERVAL 1000
+
+/**
+ * Phases of a split
+ */
+typedef enum
+{
+    /* Reading the input (including waiting for decompressed data) */
+    SPLIT_PHASE_READ,
+    /* Searching for bounds of elements */
+    SPLIT_PHASE_FIND_BOUND,
+    /* Moving data between halves of double-buffers */
+    SPLIT_PHASE_MOVE,
+    /* Writing output files */
+    SPLIT_PHASE_WRITE,
+    /* Zero-copy transfers ("copy_file_range()" and "splice()") */
+    SPLIT_PHASE_COPY,
+    /* Syncing output files */
+    SPLIT_PHASE_SYNC,
+    SPLIT_PHASE_NUM
+} split_Phase_t;
+
+/**
+ * Names of phases in the order of "split_Phase_t", and indicators that a
+ * phase consists of I/O calls (so latency histograms are reported for it)
+ */
+static const struct
+{
+    const char *name;
+    bool is_io;
+} split_phases[SPLIT_PHASE_NUM] =
+{
+    {"read", true},
+    {"find_bound", false},
+    {"move", false},
+    {"write", true},
+    {"copy", true},
+    {"sync", true}
+};
+
+/**
+ * Measurements of a phase
+ */
+typedef struct
+{
+    std::atomic<int64_t> num_calls;
+    /* Time in nanoseconds */
+    std::atomic<int64_t> time;
+    std::atomic<int64_t> bytes;
+    /* Bucket "i" counts calls that took from 2^(i-1) to 2^i microseconds. The
+       first one counts calls that took less than a microsecond */
+    std::atomic<int64_t> latencies[SPLIT_STATS_NUM_BUCKETS];
+} split_PhaseStats_t;
+
+/**
+ * Statistics of a split
+ */
+typedef struct
+{
+    bool is_enabled;
+    bool is_progress;
+    split_PhaseStats_t phases[SPLIT_PHASE_NUM];
+    /* Input bytes transferred to output files, and total amount of bytes to
+       transfer ("-1" if it's unknown) */
+    std::atomic<int64_t> bytes_done;
+    int64_t bytes_total;
+    /* Start of the split in nanoseconds */
+    int64_t start_time;
+    std::mutex lock;
+    /* Distances between projected and found bounds of pieces */
+    std::vector<int64_t> bound_distances;
+    /* Sizes of written pieces by their numbers ("-1" if size is unknown) */
+    std::map<int64_t, int64_t> piece_sizes;
+    /* Peak amount of memory taken by data buffers */
+    int64_t peak_buffers_size;
+    /* Thread printing the progress line */
+    std::thread *progress_thread;
+    bool is_progress_stopped;
+    std::condition_variable progress_cond;
+} split_Stats_t;
+
+static thread_local split_Stats_t *split_stats = NULL;
+
+/**
+ * Get current time of the monotonic clock in nanoseconds
+ */
+static int64_t split_GetTime()
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Start timing a call. Return "0" if statistics are disabled
+ */
+static inline int64_t split_StartTimer()
+{
+    return split_stats->is_enabled ? split_GetTime() : 0;
+}
+
+/**
+ * Account a call of a phase started at "start" that processed "bytes"
+ */
+static inline void split_StopTimer( split_Phase_t phase, int64_t start, int64_t bytes)
+{
+    if ( !split_stats->is_enabled )
+    {
+        return;
+    }
+
+    split_PhaseStats_t & stats = split_stats->phases[phase];
+    int64_t time = split_GetTime() - start;
+    uint64_t usecs = time / 1000;
+    int bucket = usecs ? 64 - __builtin_clzll( usecs) : 0;
+
+    stats.num_calls.fetch_add( 1, std::memory_order_relaxed);
+    stats.time.fetch_add( time, std::memory_order_relaxed);
+    stats.bytes.fetch_add( bytes, std::memory_order_relaxed);
+    stats.latencies[std::min( bucket, SPLIT_STATS_NUM_BUCKETS - 1)]
+        .fetch_add( 1, std::memory_order_relaxed);
+}
+
+/**
+ * Account input bytes transferred to output files
+ */
+static inline void split_AddProgress( int64_t bytes)
+{
+    split_stats->bytes_done.fetch_add( bytes, std::memory_order_relaxed);
+}
+
+/**
+ * Set total amount of bytes to transfer, if it's known
+ */
+static void split_SetProgressTotal( int64_t bytes)
+{
+    split_stats->bytes_total = bytes;
+}
+
+/**
+ * Record distance between projected and found bounds of a piece
+ */
+static void split_RecordBound( int64_t projected_bound, int64_t bound)
+{
+    if ( !split_stats->is_enabled )
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard( split_stats->lock);
+
+    split_stats->bound_distances.push_back( std::abs( bound - projected_bound));
+}
+
+/**
+ * Record size of a written piece
+ */
+static void split_RecordPiece( int64_t piece_num, int64_t piece_size)
+{
+    if ( !split_stats->is_enabled )
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard( split_stats->lock);
+
+    split_stats->piece_sizes[piece_num] = piece_size;
+}
+
+/**
+ * Record amount of memory taken by data buffers. The peak amount is kept
+ */
+static void split_RecordBuffers( int64_t size)
+{
+    std::lock_guard<std::mutex> guard( split_stats->lock);
+
+    split_stats->peak_buffers_size = std::max( split_stats->peak_buffers_size, size);
+}
+
+/**
+ * Format amount of bytes in human-readable units
+ */
+static void split_FormatBytes( char *buff, size_t size, double bytes)
+{
+    const char *units[] = {"B", "K", "M", "G", "T"};
+    int unit = 0;
+
+    while ( (bytes >= 1024) && (unit < 4) )
+    {
+        bytes /= 1024;
+        unit++;
+    }
+
+    snprintf( buff, size, "%.1f%s", bytes, units[unit]);
+}
+
+/**
+ * Print the progress line. Throughput is averaged over the whole split
+ */
+static void split_PrintProgress( bool is_final)
+{
+    int64_t done = split_stats->bytes_done.load( std::memory_order_relaxed);
+    double seconds = (split_GetTime() - split_stats->start_time) / 1e9;
+    double rate = seconds > 0 ? done / seconds : 0;
+    char done_str[32], rate_str[32], line[200];
+    int len = 0;
+
+    split_FormatBytes( done_str, sizeof( done_str), done);
+    split_FormatBytes( rate_str, sizeof( rate_str), rate);
+
+    if ( split_stats->bytes_total > 0 )
+    {
+        len = snprintf( line, sizeof( line), "%s of ", done_str);
+        split_FormatBytes( done_str, sizeof( done_str), split_stats->bytes_total);
+        len += snprintf( line + len, sizeof( line) - len, "%s (%.1f%%), ", done_str,
+                         100.0 * done / split_stats->bytes_total);
+    } else
+    {
+        len = snprintf( line, sizeof( line), "%s, ", done_str);
+    }
+
+    len += snprintf( line + len, sizeof( line) - len, "%s/s", rate_str);
+
+    if ( !is_final && (split_stats->bytes_total > 0) && (rate > 0) )
+    {
+        int64_t eta = (split_stats->bytes_total - std::min( done,
+                                                            split_stats->bytes_total))
+                      / rate;
+
+        snprintf( line + len, sizeof( line) - len, ", ETA %ld:%02ld:%02ld",
+                  eta / 3600, eta / 60 % 60, eta % 60);
+    }
+
+    /* Trailing spaces wipe leftovers of a longer previous line */
+    fprintf( stderr, "\r%-70s%s", line, is_final ? "\n" : "");
+}
+
+/**
+ * Start collecting statistics and printing progress
+ */
+static void split_StartStats( bool is_enabled, bool is_progress)
+{
+    /* Statistics of a previous split are dropped */
+    for ( int i = 0; i < SPLIT_PHASE_NUM; i++ )
+    {
+        split_PhaseStats_t & stats = split_stats->phases[i];
+
+        stats.num_calls = 0;
+        stats.time = 0;
+        stats.bytes = 0;
+
+        for ( int j = 0; j < SPLIT_STATS_NUM_BUCKETS; j++ )
+        {
+            stats.latencies[j] = 0;
+        }
+    }
+
+    split_stats->is_enabled = is_enabled;
+    split_stats->is_progress = is_progress;
+    split_stats->bytes_done = 0;
+    split_stats->bytes_total = -1;
+    split_stats->bound_distances.clear();
+    split_stats->piece_sizes.clear();
+    split_stats->peak_buffers_size = 0;
+    split_stats->start_time = split_GetTime();
+    split_stats->progress_thread = NULL;
+    split_stats->is_progress_stopped = false;
+
+    if ( !is_progress )
+    {
+        return;
+    }
+
+    split_stats->progress_thread = new std::thread( split_StartWorker( NULL, NULL, []()
+    {
+        std::unique_lock<std::mutex> guard( split_stats->lock);
+
+        while ( !split_stats->is_progress_stopped )
+        {
+            split_stats->progress_cond.wait_for( guard,
+                                                 std::chrono::milliseconds(
+                                                     SPLIT_PROGRESS_INTERVAL));
+
+            if ( !split_stats->is_progress_stopped )
+            {
+                split_PrintProgress( false);
+            }
+        }
+    }));
+}
+
+/**
+ * Print statistics as a single line of JSON to the standard error
+ */
+static void split_PrintStatsJson()
+{
+    double seconds = (split_GetTime() - split_stats->start_time) / 1e9;
+    int64_t done = split_stats->bytes_done.load();
+    std::string json;
+    char buff[200];
+
+    snprintf( buff, sizeof( buff), "{\"seconds\":%.6f,\"bytes\":%ld,"
+              "\"bytes_per_second\":%.0f,\"phases\":{", seconds, done,
+              seconds > 0 ? done / seconds : 0);
+    json += buff;
+
+    for ( int i = 0; i < SPLIT_PHASE_NUM; i++ )
+    {
+        split_PhaseStats_t & stats = split_stats->phases[i];
+
+        snprintf( buff, sizeof( buff), "%s\"%s\":{\"calls\":%ld,\"seconds\":%.6f,"
+                  "\"bytes\":%ld", i ? "," : "", split_phases[i].name,
+                  stats.num_calls.load(), stats.time.load() / 1e9, stats.bytes.load());
+        json += buff;
+
+        if ( split_phases[i].is_io )
+        {
+            /* Only non-empty buckets are reported. A bucket is named by its
+               upper bound in microseconds */
+            bool is_first = true;
+
+            json += ",\"latency_us\":{";
+
+            for ( int j = 0; j < SPLIT_STATS_NUM_BUCKETS; j++ )
+            {
+                int64_t count = stats.latencies[j].load();
+
+                if ( !count )
+                {
+                    continue;
+                }
+
+                if ( j == SPLIT_STATS_NUM_BUCKETS - 1 )
+                {
+                    snprintf( buff, sizeof( buff), "%s\"inf\":%ld",
+                              is_first ? "" : ",", count);
+                } else
+                {
+                    snprintf( buff, sizeof( buff), "%s\"%lld\":%ld",
+                              is_first ? "" : ",", 1LL << j, count);
+                }
+
+                json += buff;
+                is_first = false;
+            }
+
+            json += "}";
+        }
+
+        json += "}";
+    }
+
+    std::lock_guard<std::mutex> guard( split_stats->lock);
+    int64_t total_distance = 0, max_distance = 0;
+
+    json += "},\"bounds\":{\"scanned\":[";
+
+    for ( size_t i = 0; i < split_stats->bound_distances.size(); i++ )
+    {
+        int64_t distance = split_stats->bound_distances[i];
+
+        snprintf( buff, sizeof( buff), "%s%ld", i ? "," : "", distance);
+        json += buff;
+        total_distance += distance;
+        max_distance = std::max( max_distance, distance);
+    }
+
+    snprintf( buff, sizeof( buff), "],\"count\":%ld,\"total\":%ld,\"max\":%ld},"
+              "\"pieces\":{\"sizes\":[", (int64_t)split_stats->bound_distances.size(),
+              total_distance, max_distance);
+    json += buff;
+
+    /* Imbalance is the relative excess of the biggest piece over the mean
+       size. Pieces of unknown size are left out */
+    int64_t num_sized = 0, total_size = 0, min_size = -1, max_size = -1;
+
+    for ( std::map<int64_t, int64_t>::iterator it = split_stats->piece_sizes.begin();
+          it != split_stats->piece_sizes.end();
+          it++ )
+    {
+        int64_t size = it->second;
+
+        snprintf( buff, sizeof( buff), "%s%ld",
+                  it == split_stats->piece_sizes.begin() ? "" : ",", size);
+        json += buff;
+
+        if ( size == -1 )
+        {
+            continue;
+        }
+
+        num_sized++;
+        total_size += size;
+        min_size = (min_size == -1) ? size : std::min( min_size, size);
+        max_size = std::max( max_size, size);
+    }
+
+    double mean_size = num_sized ? (double)total_size / num_sized : 0;
+
+    snprintf( buff, sizeof( buff), "],\"count\":%ld,\"min\":%ld,\"max\":%ld,"
+              "\"mean\":%.1f,\"imbalance\":%.6f},\"peak_buffers_bytes\":%ld}",
+              (int64_t)split_stats->piece_sizes.size(), min_size, max_size, mean_size,
+              mean_size > 0 ? max_size / mean_size - 1 : 0,
+              split_stats->peak_buffers_size);
+    json += buff;
+    fprintf( stderr, "%s\n", json.c_str());
+}
+
+/**
+ * Stop the thread printing progress
+ */
+static void split_StopProgress()
+{
+    {
+        std::lock_guard<std::mutex> guard( split_stats->lock);
+
+        split_stats->is_progress_stopped = true;
+        split_stats->progress_cond.notify_all();
+    }
+
+    split_stats->progress_thread->join();
+    delete split_stats->progress_thread;
+    split_stats->progress_thread = NULL;
+}
+
+/**
+ * Stop printing progress and print statistics
+ */
+static void split_StopStats()
+{
+    if ( split_stats->progress_thread )
+    {
+        split_StopProgress();
+        split_PrintProgress( true);
+    }
+
+    if ( split_stats->is_enabled )
+    {
+        split_PrintStatsJson();
+    }
+}
+
+/**
+ * Stop printing progress of a failed split. Statistics are not printed
+ */
+static void split_AbortStats()
+{
+    if ( split_stats->progress_thread )
+    {
+        split_StopProgress();
+        /* Finish the progress line */
+        fprintf( stderr, "\n");
+    }
+}
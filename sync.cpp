@@ -0,0 +1,295 @@
+/**
+ * Copyright © 2016 Andrey Nevolin, https://github.com/AndreyNevolin
+ * Twitter: @Andrey_Nevolin
+ * LinkedIn: https://www.linkedin.com/in/andrey-nevolin-76387328
+ *
+ * Durability of output files
+ *
+ * Output files may be synced to persistent store in one of the modes:
+ *   each     - each piece is synced right after it's written, before the next
+ *              piece is started. A piece reported as written survives a crash
+ *              of the system
+ *   deferred - writeback of a piece is started when the piece is written
+ *              ("sync_file_range()"), and the piece is synced by a pool of
+ *              threads while next pieces are written. All pieces survive a
+ *              crash of the system once the tool exits successfully. A piece
+ *              reported as written may be lost before that
+ *   end      - pieces are synced by a pool of threads in parallel when all of
+ *              them are written. The guarantee is the same as for "deferred",
+ *              but the data stays in the page cache until the end
+ *   none     - pieces are not synced. They survive a crash of the tool but not
+ *              a crash of the system
+ *
+ * In all modes but "none" the output directory is synced at the end, so that
+ * names of the pieces survive a crash of the system too
+ */
+
+/* Number of threads syncing pieces in "deferred" and "end" modes */
+#define SPLIT_SYNC_NUM_THREADS 8
+/* Maximum number of written pieces waiting to be synced in "deferred" mode.
+   Files of the pieces are kept open until they are synced */
+#define SPLIT_SYNC_MAX_PENDING 64
+
+/**
+ * Modes of syncing output files
+ */
+typedef enum
+{
+    SPLIT_SYNC_EACH,
+    SPLIT_SYNC_DEFERRED,
+    SPLIT_SYNC_END,
+    SPLIT_SYNC_NONE
+} split_Sync_t;
+
+/**
+ * Syncer of output files
+ */
+typedef struct
+{
+    split_Sync_t mode;
+    /* Output directory */
+    std::string dir;
+    /* Descriptors of pieces waiting to be synced in "deferred" mode */
+    std::deque<int> fds;
+    /* Paths of all pieces in "end" mode */
+    std::vector<std::string> paths;
+    bool is_stopped;
+    std::mutex lock;
+    std::condition_variable cond;
+    std::vector<std::thread> threads;
+} split_Syncer_t;
+
+static thread_local split_Syncer_t *split_syncer = NULL;
+
+/**
+ * Sync a file to persistent store. "size" is the amount of data in the file
+ */
+static void split_SyncFile( int fd, int64_t size)
+{
+    char err_msg[500];
+    int64_t start = split_StartTimer();
+
+    if ( fsync( fd) == -1 )
+    {
+        SPLIT_ERROR( "Cannot sync output file: %s",
+                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+    }
+
+    split_StopTimer( SPLIT_PHASE_SYNC, start, size);
+}
+
+/**
+ * Thread syncing pieces in "deferred" mode. Pieces are closed when synced
+ */
+static void split_SyncDeferred( split_Syncer_t *syncer)
+{
+    while ( 1 )
+    {
+        int fd = -1;
+
+        {
+            std::unique_lock<std::mutex> guard( syncer->lock);
+
+            while ( !syncer->is_stopped && syncer->fds.empty() )
+            {
+                syncer->cond.wait( guard);
+            }
+
+            if ( syncer->fds.empty() )
+            {
+                return;
+            }
+
+            fd = syncer->fds.front();
+            syncer->fds.pop_front();
+            /* Wake up the splitting loop waiting for room in the queue */
+            syncer->cond.notify_all();
+        }
+
+        split_SyncFile( fd, lseek( fd, 0, SEEK_END));
+        close( fd);
+    }
+}
+
+/**
+ * Start syncing output files in a given mode
+ */
+static void split_StartSyncer( split_Sync_t mode, const std::string & dir)
+{
+    split_syncer->mode = mode;
+    split_syncer->dir = dir;
+    split_syncer->is_stopped = false;
+
+    for ( int i = 0; (mode == SPLIT_SYNC_DEFERRED) && (i < SPLIT_SYNC_NUM_THREADS); i++ )
+    {
+        split_syncer->threads.push_back( split_StartWorker( &split_syncer->lock,
+                                                            &split_syncer->cond,
+                                                            std::bind( split_SyncDeferred,
+                                                                       split_syncer)));
+    }
+}
+
+/**
+ * Account a newly created output file
+ */
+static void split_AddSyncedFile( const std::string & path)
+{
+    if ( split_syncer->mode != SPLIT_SYNC_END )
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard( split_syncer->lock);
+
+    split_syncer->paths.push_back( path);
+}
+
+/**
+ * Sync (or schedule syncing of) a written piece and close its file.
+ * "size" is the amount of data in the file
+ */
+static void split_SyncPiece( int fd, int64_t size)
+{
+    switch ( split_syncer->mode )
+    {
+        case SPLIT_SYNC_EACH:
+            split_SyncFile( fd, size);
+            close( fd);
+
+            break;
+
+        case SPLIT_SYNC_DEFERRED:
+        {
+            /* Only a hint to start writeback now instead of when the piece is
+               synced. Failures are not important */
+            sync_file_range( fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+
+            std::unique_lock<std::mutex> guard( split_syncer->lock);
+
+            while ( (split_syncer->fds.size() >= SPLIT_SYNC_MAX_PENDING)
+                    && !split_workers->is_failed )
+            {
+                split_syncer->cond.wait( guard);
+            }
+
+            split_CheckWorkers();
+
+            split_syncer->fds.push_back( fd);
+            split_syncer->cond.notify_all();
+
+            break;
+        }
+
+        case SPLIT_SYNC_END:
+        case SPLIT_SYNC_NONE:
+            close( fd);
+
+            break;
+    }
+}
+
+/**
+ * Finish syncing output files: wait for pending syncs, sync pieces in "end"
+ * mode, and sync the output directory
+ */
+static void split_StopSyncer()
+{
+    char err_msg[500];
+
+    if ( split_syncer->mode == SPLIT_SYNC_NONE )
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard( split_syncer->lock);
+
+        split_syncer->is_stopped = true;
+        split_syncer->cond.notify_all();
+    }
+
+    for ( size_t i = 0; i < split_syncer->threads.size(); i++ )
+    {
+        split_syncer->threads[i].join();
+    }
+
+    split_syncer->threads.clear();
+
+    /* Sync all pieces in parallel. Each thread takes pieces one by one */
+    std::atomic<size_t> next_path( 0);
+    int64_t num_threads = std::min( (size_t)SPLIT_SYNC_NUM_THREADS,
+                                    split_syncer->paths.size());
+
+    for ( int64_t i = 0; i < num_threads; i++ )
+    {
+        split_syncer->threads.push_back( split_StartWorker( NULL, NULL, [&]()
+        {
+            char err_msg[500];
+
+            for ( size_t path_num = next_path++;
+                  (path_num < split_syncer->paths.size()) && !split_workers->is_failed;
+                  path_num = next_path++ )
+            {
+                const char *path = split_syncer->paths[path_num].c_str();
+                int fd = open( path, O_RDONLY);
+
+                if ( fd == -1 )
+                {
+                    SPLIT_ERROR( "Cannot open output file \"%s\": %s", path,
+                                 SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+                }
+
+                split_SyncFile( fd, lseek( fd, 0, SEEK_END));
+                close( fd);
+            }
+        }));
+    }
+
+    for ( size_t i = 0; i < split_syncer->threads.size(); i++ )
+    {
+        split_syncer->threads[i].join();
+    }
+
+    split_syncer->threads.clear();
+    split_syncer->paths.clear();
+    split_CheckWorkers();
+
+    int fd_dir = open( split_syncer->dir.c_str(), O_RDONLY | O_DIRECTORY);
+
+    if ( (fd_dir == -1) || (fsync( fd_dir) == -1) )
+    {
+        SPLIT_ERROR( "Cannot sync output directory \"%s\": %s",
+                     split_syncer->dir.c_str(),
+                     SPLIT_STRERROR_R( err_msg, sizeof( err_msg)));
+    }
+
+    close( fd_dir);
+}
+
+/**
+ * Stop syncing output files of a failed split. Pieces waiting to be synced
+ * are closed without syncing
+ */
+static void split_AbortSyncer()
+{
+    {
+        std::lock_guard<std::mutex> guard( split_syncer->lock);
+
+        while ( !split_syncer->fds.empty() )
+        {
+            close( split_syncer->fds.front());
+            split_syncer->fds.pop_front();
+        }
+
+        split_syncer->is_stopped = true;
+        split_syncer->cond.notify_all();
+    }
+
+    for ( size_t i = 0; i < split_syncer->threads.size(); i++ )
+    {
+        split_syncer->threads[i].join();
+    }
+
+    split_syncer->threads.clear();
+    split_syncer->paths.clear();
+}
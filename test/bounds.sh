@@ -0,0 +1,201 @@
+#!/bin/bash
+#
+# Copyright © 2016 Andrey Nevolin, https://github.com/AndreyNevolin
+# Twitter: @Andrey_Nevolin
+# LinkedIn: https://www.linkedin.com/in/andrey-nevolin-76387328
+#
+# Regression tests of element bounds. Each input (FASTQ, newline-delimited
+# text, CSV) has a long element close to its end. The element is longer than
+# the distance from its start to the projected bound, so the closest bound
+# lies to the left of the projected one. The input is split into two
+# pieces with each engine. The first piece must end right before the long
+# element, and the pieces must add up to the input
+#
+# Inputs split as they are read must be split completely: the tool must exit
+# in time, and the pieces must add up to the input
+#
+# Usage: bounds.sh <path to split>
+
+SPLIT=$1
+
+if [ -z "$SPLIT" ]
+then
+    echo "Usage: $0 <path to split>"
+    exit 1
+fi
+
+WORK_DIR=$(mktemp -d)
+trap "rm -rf $WORK_DIR" EXIT
+
+FAILED=0
+
+# Split "input" into two pieces with each engine. "head_size" is the expected
+# size of the first piece
+check_split()
+{
+    local name=$1 format=$2 input=$3 head_size=$4
+    local mode
+
+    for mode in "" "--engine pipeline" "--engine mmap" "--buffer halves" "-j 2"
+    do
+        local out=$WORK_DIR/out
+        local result="ok"
+
+        rm -rf $out
+        mkdir $out
+
+        "$SPLIT" -n 2 --format $format $mode --od $out $input > $WORK_DIR/log 2>&1
+        local status=$?
+
+        if [ $status != 0 ]
+        then
+            result="exit status $status"
+        elif [ $(ls $out | wc -l) != 2 ]
+        then
+            result="$(ls $out | wc -l) pieces"
+        elif [ $(stat -c %s $out/*.0) != $head_size ]
+        then
+            result="first piece of $(stat -c %s $out/*.0) bytes, expected $head_size"
+        elif ! cat $out/*.0 $out/*.1 | cmp -s - $input
+        then
+            result="pieces differ from the input"
+        fi
+
+        if [ "$result" != "ok" ]
+        then
+            FAILED=1
+        fi
+
+        printf "%-24s %-18s %s\n" $name "${mode:-rw}" "$result"
+    done
+}
+
+# Split an input as a stream. Arguments following "source" are options of the
+# tool and the input. The standard input is fed from "source". Pieces are
+# written to "$WORK_DIR/out" named "piece.<number>". They must add up to
+# "source"
+check_stream()
+{
+    local name=$1 source=$2
+    local out=$WORK_DIR/out
+    local result="ok"
+
+    shift 2
+    mkdir -p $out
+    timeout 60 "$SPLIT" --od $out --of piece "$@" < $source > $WORK_DIR/log 2>&1
+    local status=$?
+
+    if [ $status = 124 ]
+    then
+        result="timed out"
+    elif [ $status != 0 ]
+    then
+        result="exit status $status"
+    elif [ $(ls $out/piece.[0-9]* | wc -l) -lt 2 ]
+    then
+        result="$(ls $out/piece.[0-9]* | wc -l) pieces"
+    elif ! cat $(ls -v $out/piece.[0-9]*) | cmp -s - $source
+    then
+        result="pieces differ from the input"
+    fi
+
+    if [ "$result" != "ok" ]
+    then
+        FAILED=1
+    fi
+
+    printf "%-24s %-18s %s\n" $name stream "$result"
+}
+
+# FASTQ: 100 short records and a record of 30000 bases
+FASTQ=$WORK_DIR/long_last.fq
+
+awk 'function repeat( c, n,    s) { while ( length( s) < n ) s = s c; return s }
+BEGIN {
+    for ( i = 0; i < 100; i++ )
+    {
+        printf( "@read%d\n%s\n+\n%s\n", i, repeat( "A", 150), repeat( "I", 150));
+    }
+    printf( "@long\n%s\n+\n%s\n", repeat( "C", 30000), repeat( "I", 30000));
+}' > $FASTQ
+
+check_split fastq-long-last fastq $FASTQ $(head -n 400 $FASTQ | wc -c)
+
+# Newline-delimited text: 1000 short lines and a line of 20000 characters
+LINES=$WORK_DIR/long_last.txt
+
+awk 'function repeat( c, n,    s) { while ( length( s) < n ) s = s c; return s }
+BEGIN {
+    for ( i = 0; i < 1000; i++ )
+    {
+        printf( "line %d\n", i);
+    }
+    printf( "%s\n", repeat( "x", 20000));
+}' > $LINES
+
+check_split lines-long-last lines $LINES $(head -n 1000 $LINES | wc -c)
+
+# The same followed by 100 short lines
+LINES_MIDDLE=$WORK_DIR/long_middle.txt
+
+cp $LINES $LINES_MIDDLE
+head -n 100 $LINES >> $LINES_MIDDLE
+
+check_split lines-long-middle lines $LINES_MIDDLE $(head -n 1000 $LINES | wc -c)
+
+# CSV: 1000 short rows and a row with a quoted field of 20000 characters
+# spread over several lines
+CSV=$WORK_DIR/long_last.csv
+
+awk 'function repeat( c, n,    s) { while ( length( s) < n ) s = s c; return s }
+BEGIN {
+    for ( i = 0; i < 1000; i++ )
+    {
+        printf( "row%d,%d\n", i, i * 7);
+    }
+    printf( "long,\"%s\n%s\"\n", repeat( "x", 10000), repeat( "y", 10000));
+}' > $CSV
+
+check_split csv-long-last csv $CSV $(head -n 1000 $CSV | wc -c)
+
+# FASTQ of 10000 short records split as a stream, from a file and from the
+# standard input
+STREAM=$WORK_DIR/stream.fq
+
+awk 'function repeat( c, n,    s) { while ( length( s) < n ) s = s c; return s }
+BEGIN {
+    for ( i = 0; i < 10000; i++ )
+    {
+        printf( "@read%d\n%s\n+\n%s\n", i, repeat( "A", 150), repeat( "I", 150));
+    }
+}' > $STREAM
+
+rm -rf $WORK_DIR/out
+check_stream piece-size $STREAM --format fastq --piece-size 1M $STREAM
+rm -rf $WORK_DIR/out
+check_stream piece-size-stdin $STREAM --format fastq --piece-size 1M -
+
+# The same compressed
+gzip -c $STREAM > $STREAM.gz
+
+rm -rf $WORK_DIR/out
+check_stream piece-size-gzip $STREAM --format fastq --piece-size 1M $STREAM.gz
+
+# Split by number of records
+rm -rf $WORK_DIR/out
+check_stream records-per-piece $STREAM --format fastq --records-per-piece 3000 \
+             $STREAM
+
+# Incremental split of the first half of the records, and then of the whole
+# input once the rest is appended
+GROWING=$WORK_DIR/growing.fq
+
+head -n 20000 $STREAM > $GROWING
+rm -rf $WORK_DIR/out
+check_stream incremental-first $GROWING --format fastq --piece-size 500K \
+             --incremental $GROWING
+tail -n +20001 $STREAM >> $GROWING
+check_stream incremental-grown $GROWING --format fastq --piece-size 500K \
+             --incremental $GROWING
+
+exit $FAILED
@@ -0,0 +1,201 @@
+/**
+ * Copyright © 2016 Andrey Nevolin, https://github.com/AndreyNevolin
+ * Twitter: @Andrey_Nevolin
+ * LinkedIn: https://www.linkedin.com/in/andrey-nevolin-76387328
+ *
+ * Weighing of data by the number of records or by the number of residues
+ * (sequence symbols, i.e. bytes of records excluding headers and newlines)
+ *
+ * Pieces are balanced by weight when the cost of processing a piece depends
+ * on the number of records or on the length of sequences rather than on the
+ * size of the piece. The weigher walks data sequentially and classifies each
+ * line by the record layout of the format. The weight of a record is
+ * attributed to the first byte of the record, and the weight of a residue to
+ * the residue itself. So the weight of data may be summed over any partition
+ * of the data, provided that the partitions are weighed in order
+ *
+ * Lines are found with the byte search (see "byte_search.cpp"). Records of
+ * line-counted layouts are counted without visiting individual lines
+ */
+
+/**
+ * Layouts of records. Define how lines of a file are grouped into records
+ */
+typedef enum
+{
+    /* A record starts with a header line starting with '>' and continues
+       with sequence lines */
+    SPLIT_LAYOUT_FASTA,
+    /* A record consists of four lines: header, sequence, separator and
+       quality */
+    SPLIT_LAYOUT_FASTQ,
+    /* Each line is a record, and all its bytes are residues */
+    SPLIT_LAYOUT_LINES,
+    /* The same as lines, except that newlines inside quoted fields don't end
+       a record. Data is still weighed by lines */
+    SPLIT_LAYOUT_CSV
+} split_RecordLayout_t;
+
+/**
+ * Measures of weight
+ */
+typedef enum
+{
+    SPLIT_WEIGHT_RECORDS,
+    SPLIT_WEIGHT_RESIDUES
+} split_WeightMeasure_t;
+
+/**
+ * State of weighing. Describes the position right after the data weighed so
+ * far
+ */
+typedef struct
+{
+    split_RecordLayout_t layout;
+    split_WeightMeasure_t measure;
+    /* Number of the line the position belongs to (counted from the start of
+       the data) */
+    int64_t line_num;
+    /* Indicator that the position starts a line */
+    bool is_line_start;
+    /* Indicator that the current line consists of residues */
+    bool is_sequence_line;
+} split_Weigher_t;
+
+/**
+ * Start weighing data. The data should start with a record
+ */
+static void split_StartWeigher( split_Weigher_t *weigher,
+                                split_RecordLayout_t layout,
+                                split_WeightMeasure_t measure)
+{
+    weigher->layout = layout;
+    weigher->measure = measure;
+    weigher->line_num = 0;
+    weigher->is_line_start = true;
+    weigher->is_sequence_line = false;
+}
+
+/**
+ * Count records of a line-counted layout without visiting individual lines
+ */
+static int64_t split_CountLineRecords( split_Weigher_t *weigher,
+                                       const char *data,
+                                       int64_t size)
+{
+    int64_t new_lines = split_GetByteSearch()->count( data, data + size, '\n');
+    /* Number of the first line starting inside the data, and the number of
+       lines starting inside the data. A newline ending the data starts a line
+       outside of it */
+    int64_t first_line = weigher->line_num + (weigher->is_line_start ? 0 : 1);
+    int64_t num_lines = (weigher->is_line_start ? 1 : 0) + new_lines
+                        - (data[size - 1] == '\n' ? 1 : 0);
+    int64_t weight = num_lines;
+
+    if ( weigher->layout == SPLIT_LAYOUT_FASTQ )
+    {
+        /* Number of multiples of 4 among the line numbers */
+        weight = (first_line + num_lines + 3) / 4 - (first_line + 3) / 4;
+    }
+
+    weigher->line_num += new_lines;
+    weigher->is_line_start = (data[size - 1] == '\n');
+
+    return weight;
+}
+
+/**
+ * Weigh data starting at the position described by the weigher. Weighing
+ * stops at the end of the data or right before a byte that would make the
+ * weight exceed "max_weight". Return the weight. The number of bytes weighed
+ * is placed to "size_weighed", and the weigher is moved past them
+ */
+static int64_t split_Weigh( split_Weigher_t *weigher,
+                            const char *data,
+                            int64_t size,
+                            int64_t max_weight,
+                            int64_t *size_weighed)
+{
+    const split_ByteSearch_t *search = split_GetByteSearch();
+    int64_t weight = 0;
+    int64_t offset = 0;
+
+    if ( size && (max_weight == INT64_MAX) && (weigher->measure == SPLIT_WEIGHT_RECORDS)
+         && (weigher->layout != SPLIT_LAYOUT_FASTA) )
+    {
+        *size_weighed = size;
+
+        return split_CountLineRecords( weigher, data, size);
+    }
+
+    while ( offset < size )
+    {
+        if ( weigher->is_line_start )
+        {
+            bool is_record_start = false;
+
+            switch ( weigher->layout )
+            {
+                case SPLIT_LAYOUT_FASTA:
+                    is_record_start = (data[offset] == '>');
+                    weigher->is_sequence_line = !is_record_start;
+
+                    break;
+
+                case SPLIT_LAYOUT_FASTQ:
+                    is_record_start = (weigher->line_num % 4 == 0);
+                    weigher->is_sequence_line = (weigher->line_num % 4 == 1);
+
+                    break;
+
+                case SPLIT_LAYOUT_LINES:
+                case SPLIT_LAYOUT_CSV:
+                    is_record_start = true;
+                    weigher->is_sequence_line = true;
+
+                    break;
+            }
+
+            if ( is_record_start && (weigher->measure == SPLIT_WEIGHT_RECORDS) )
+            {
+                if ( weight == max_weight )
+                {
+                    break;
+                }
+
+                weight++;
+            }
+
+            weigher->is_line_start = false;
+        }
+
+        const char *new_line = search->find_first( data + offset, data + size, '\n');
+        int64_t line_end = new_line ? new_line - data : size;
+
+        if ( weigher->is_sequence_line && (weigher->measure == SPLIT_WEIGHT_RESIDUES) )
+        {
+            if ( line_end - offset > max_weight - weight )
+            {
+                offset += max_weight - weight;
+                weight = max_weight;
+
+                break;
+            }
+
+            weight += line_end - offset;
+        }
+
+        offset = line_end;
+
+        if ( new_line )
+        {
+            offset++;
+            weigher->line_num++;
+            weigher->is_line_start = true;
+        }
+    }
+
+    *size_weighed = offset;
+
+    return weight;
+}